@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include "xdwayland-bench.h"
+#include "xdwayland-client.h"
+#include "xdwayland-core.h"
+#include "xdwayland-mock.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#define DEFAULT_ROUNDTRIPS 10000
+#define DEFAULT_EVENTS 1000000
+
+#define POINTER_MOTION 2
+#define KEYBOARD_KEY 3
+#define REGISTRY_GLOBAL 0
+
+enum flood_kind {
+  FLOOD_MOTION,
+  FLOOD_KEY,
+  FLOOD_GLOBAL,
+};
+
+struct flood {
+  enum flood_kind kind;
+  const char *variant;
+  struct xdwl_mock *mock;
+  xdwl_id object_id; // the mock's id of the object the events go to
+  uint64_t events;
+  int cpu;
+};
+
+static xdwl_proxy *proxy;
+static xdwl_id registry_id;
+static uint64_t handled;
+static int flooding;
+
+static int pin(int cpu) {
+  cpu_set_t set;
+
+  if (cpu < 0)
+    return 0;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (r != 0) {
+    fprintf(stderr, "pthread_setaffinity_np: cpu %d: %s\n", cpu, strerror(r));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void count(void *data, xdwl_arg *args) { handled++; }
+
+static void global(void *data, xdwl_arg *args) {
+  if (flooding) {
+    handled++;
+    return;
+  }
+
+  if (strcmp(args[2].s, "wl_seat") != 0)
+    return;
+
+  xdwl_id seat_id = xdwl_object_register(proxy, 0, "wl_seat");
+  if (seat_id == 0 ||
+      xdwl_registry_bind(proxy, registry_id, args[1].u, args[2].s, args[3].u,
+                         seat_id) == -1)
+    xdwl_error_print();
+}
+
+// produces the whole flood from its own thread, the mock's writes block
+// once the socket is full and only the client's dispatching unblocks them
+static void *flood_main(void *data) {
+  struct flood *flood = data;
+  int r = 0;
+
+  pin(flood->cpu);
+
+  for (uint64_t i = 0; i < flood->events && r == 0; i++) {
+    switch (flood->kind) {
+    case FLOOD_MOTION:
+      r = xdwl_mock_queue_event(flood->mock, flood->object_id, POINTER_MOTION,
+                                (uint32_t)i, (double)(i & 1023),
+                                (double)(i >> 10 & 1023));
+      break;
+
+    case FLOOD_KEY:
+      r = xdwl_mock_queue_event(flood->mock, flood->object_id, KEYBOARD_KEY,
+                                (uint32_t)i, (uint32_t)i, (uint32_t)(i & 127),
+                                (uint32_t)(i & 1));
+      break;
+
+    case FLOOD_GLOBAL:
+      r = xdwl_mock_queue_event(flood->mock, flood->object_id,
+                                REGISTRY_GLOBAL, (uint32_t)(1000 + i),
+                                "zwp_linux_dmabuf_v1", (uint32_t)4);
+      break;
+    }
+  }
+
+  if (r == 0)
+    r = xdwl_mock_flush(flood->mock);
+
+  // the client would wait forever for the rest
+  if (r == -1) {
+    xdwl_error_print();
+    exit(1);
+  }
+
+  return NULL;
+}
+
+static int bench_roundtrip(uint64_t roundtrips) {
+  struct bench_counters counters;
+  uint64_t *samples = malloc(roundtrips * sizeof(uint64_t));
+  if (!samples) {
+    perror("malloc");
+    return -1;
+  }
+
+  bench_counters_open(&counters);
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+
+  for (uint64_t i = 0; i < roundtrips; i++) {
+    uint64_t t = bench_now_ns();
+
+    if (xdwl_roundtrip(proxy) == -1) {
+      bench_counters_close(&counters);
+      free(samples);
+      return -1;
+    }
+
+    samples[i] = bench_now_ns() - t;
+  }
+
+  uint64_t ns = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+
+  qsort(samples, roundtrips, sizeof(uint64_t), compare_u64);
+
+  char extra[160];
+  snprintf(extra, sizeof(extra),
+           "\"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, "
+           "\"max_ns\": %lu",
+           samples[(roundtrips - 1) * 50 / 100],
+           samples[(roundtrips - 1) * 99 / 100],
+           samples[(roundtrips - 1) * 999 / 1000], samples[roundtrips - 1]);
+  bench_json_result("roundtrip", "idle", roundtrips, ns, &counters, extra);
+
+  bench_counters_close(&counters);
+  free(samples);
+
+  return 0;
+}
+
+// events per second the client gets through with the server never waiting
+// on it, the ceiling for dispatch_message and everything under it
+static int bench_flood(struct flood *flood) {
+  struct bench_counters counters;
+  pthread_t thread;
+  uint64_t dispatches = 0;
+
+  handled = 0;
+  flooding = 1;
+
+  bench_counters_open(&counters);
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+
+  if (pthread_create(&thread, NULL, flood_main, flood) != 0) {
+    perror("pthread_create");
+    bench_counters_close(&counters);
+    return -1;
+  }
+
+  while (handled < flood->events) {
+    if (xdwl_dispatch(proxy) == -1) {
+      pthread_join(thread, NULL);
+      bench_counters_close(&counters);
+      return -1;
+    }
+    dispatches++;
+  }
+
+  uint64_t ns = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  pthread_join(thread, NULL);
+  flooding = 0;
+
+  char extra[96];
+  snprintf(extra, sizeof(extra),
+           "\"dispatch_calls\": %lu, \"events_per_dispatch\": %.1f",
+           dispatches, (double)flood->events / dispatches);
+  bench_json_result("dispatch", flood->variant, flood->events, ns, &counters,
+                    extra);
+  bench_counters_close(&counters);
+
+  return 0;
+}
+
+static int setup(struct xdwl_mock *mock) {
+  if (xdwl_mock_add_global(mock, "wl_compositor", 4) == 0 ||
+      xdwl_mock_add_global(mock, "wl_shm", 1) == 0 ||
+      xdwl_mock_add_global(mock, "wl_seat", 7) == 0)
+    return -1;
+
+  proxy = xdwl_proxy_create_from_fd(xdwl_mock_get_client_fd(mock));
+  if (!proxy)
+    return -1;
+
+  if (xdwl_object_register(proxy, 1, "wl_display") != 1)
+    return -1;
+
+  registry_id = xdwl_object_register(proxy, 0, "wl_registry");
+  struct xdwl_registry_event_handlers registry = {.global = global};
+  if (registry_id == 0 || xdwl_registry_add_listener(proxy, &registry, NULL) ||
+      xdwl_display_get_registry(proxy, registry_id) == -1 ||
+      xdwl_roundtrip(proxy) == -1)
+    return -1;
+
+  // the bind went out from the global handler, the seat is known after this
+  if (xdwl_roundtrip(proxy) == -1)
+    return -1;
+
+  struct xdwl_object *seat = xdwl_object_get_by_name(proxy, "wl_seat");
+  if (!seat)
+    return -1;
+
+  xdwl_id pointer_id = xdwl_object_register(proxy, 0, "wl_pointer");
+  struct xdwl_pointer_event_handlers pointer = {.motion = count};
+  if (pointer_id == 0 || xdwl_pointer_add_listener(proxy, &pointer, NULL) ||
+      xdwl_seat_get_pointer(proxy, seat->id, pointer_id) == -1)
+    return -1;
+
+  xdwl_id keyboard_id = xdwl_object_register(proxy, 0, "wl_keyboard");
+  struct xdwl_keyboard_event_handlers keyboard = {.key = count};
+  if (keyboard_id == 0 || xdwl_keyboard_add_listener(proxy, &keyboard, NULL) ||
+      xdwl_seat_get_keyboard(proxy, seat->id, keyboard_id) == -1)
+    return -1;
+
+  return xdwl_roundtrip(proxy);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-n roundtrips] [-e events] [-c client cpu] "
+          "[-s server cpu]\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t roundtrips = DEFAULT_ROUNDTRIPS;
+  uint64_t events = DEFAULT_EVENTS;
+  int client_cpu = -1, server_cpu = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:e:c:s:")) != -1) {
+    switch (opt) {
+    case 'n':
+      roundtrips = strtoull(optarg, NULL, 10);
+      break;
+    case 'e':
+      events = strtoull(optarg, NULL, 10);
+      break;
+    case 'c':
+      client_cpu = atoi(optarg);
+      break;
+    case 's':
+      server_cpu = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (roundtrips == 0 || events == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // the mock's thread inherits the affinity it's created with
+  if (pin(server_cpu) == -1)
+    return 1;
+
+  struct xdwl_mock *mock = xdwl_mock_create();
+  if (!mock) {
+    xdwl_error_print();
+    return 1;
+  }
+
+  if (pin(client_cpu) == -1 || setup(mock) == -1) {
+    xdwl_error_print();
+    if (proxy)
+      xdwl_proxy_destroy(proxy);
+    xdwl_mock_destroy(mock);
+    return 1;
+  }
+
+  struct flood floods[] = {
+      {FLOOD_MOTION, "pointer_motion", mock,
+       xdwl_mock_find_object(mock, "wl_pointer"), events, server_cpu},
+      {FLOOD_KEY, "keyboard_key", mock,
+       xdwl_mock_find_object(mock, "wl_keyboard"), events, server_cpu},
+      {FLOOD_GLOBAL, "registry_global", mock,
+       xdwl_mock_find_object(mock, "wl_registry"), events, server_cpu},
+  };
+  size_t flood_count = sizeof(floods) / sizeof(floods[0]);
+  int ret = 0;
+
+  bench_json_begin("dispatch");
+
+  if (bench_roundtrip(roundtrips) == -1)
+    ret = 1;
+
+  for (size_t i = 0; i < flood_count && ret == 0; i++) {
+    if (bench_flood(&floods[i]) == -1)
+      ret = 1;
+  }
+
+  bench_json_end();
+
+  if (ret)
+    xdwl_error_print();
+
+  xdwl_proxy_destroy(proxy);
+  xdwl_mock_destroy(mock);
+
+  return ret;
+}
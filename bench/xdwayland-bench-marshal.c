@@ -0,0 +1,275 @@
+#include "xdwayland-bench.h"
+#include "xdwayland-client.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#define DEFAULT_ITERATIONS 1000000
+#define LONG_STRING_LENGTH 1024
+#define CAP 4096 // same as the library's message buffer
+
+typedef int(marshal_send)(xdwl_proxy *, xdwl_id, xdwl_arg *);
+
+struct marshal_case {
+  const char *variant;
+  const char *interface;
+  char *signature;
+  size_t arg_count;
+  xdwl_arg args[6];
+  marshal_send *send;
+};
+
+static int send_set_cursor(xdwl_proxy *proxy, xdwl_id id, xdwl_arg *a) {
+  return xdwl_pointer_set_cursor(proxy, id, a[0].u, a[1].u, a[2].i, a[3].i);
+}
+
+static int send_create_buffer(xdwl_proxy *proxy, xdwl_id id, xdwl_arg *a) {
+  return xdwl_shm_pool_create_buffer(proxy, id, a[0].u, a[1].i, a[2].i,
+                                     a[3].i, a[4].i, a[5].u);
+}
+
+static int send_offer(xdwl_proxy *proxy, xdwl_id id, xdwl_arg *a) {
+  return xdwl_data_source_offer(proxy, id, a[0].s);
+}
+
+static int send_set_title(xdwl_proxy *proxy, xdwl_id id, xdwl_arg *a) {
+  return xdwl_shell_surface_set_title(proxy, id, a[0].s);
+}
+
+static int send_create_pool(xdwl_proxy *proxy, xdwl_id id, xdwl_arg *a) {
+  return xdwl_shm_create_pool(proxy, id, a[0].u, a[1].fd, a[2].i);
+}
+
+static volatile uint64_t sink;
+
+// reads everything the proxy sends, closing the fds the kernel dup'd for us
+// so create_pool doesn't run the process out of them
+static void *drain(void *data) {
+  int fd = *(int *)data;
+  char buffer[1 << 16];
+  char cmsg[CMSG_SPACE(sizeof(int) * XDWL_PROXY_MAX_FDS)];
+
+  for (;;) {
+    struct iovec e = {buffer, sizeof(buffer)};
+    struct msghdr m = {NULL, 0, &e, 1, cmsg, sizeof(cmsg), 0};
+
+    if (recvmsg(fd, &m, MSG_CMSG_CLOEXEC) <= 0)
+      break;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&m); c != NULL;
+         c = CMSG_NXTHDR(&m, c)) {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+        continue;
+
+      size_t fd_count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < fd_count; i++)
+        close(((int *)CMSG_DATA(c))[i]);
+    }
+  }
+
+  return NULL;
+}
+
+// untimed, so the first variant measured doesn't pay for cold caches and
+// branch predictors
+static void warm_up(struct marshal_case *c, uint64_t iterations) {
+  char buffer[CAP];
+  size_t offset;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    offset = 0;
+    xdwl_write_args(buffer, &offset, c->args, c->arg_count, c->signature);
+    sink += xdwl_calculate_body_size(c->args, c->arg_count, c->signature);
+  }
+}
+
+static void bench_body_size(struct marshal_case *c, uint64_t iterations) {
+  struct bench_counters counters;
+  uint64_t total = 0;
+
+  bench_counters_open(&counters);
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+
+  for (uint64_t i = 0; i < iterations; i++)
+    total += xdwl_calculate_body_size(c->args, c->arg_count, c->signature);
+
+  uint64_t ns = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  sink = total;
+
+  bench_json_result("calculate_body_size", c->variant, iterations, ns,
+                    &counters, NULL);
+  bench_counters_close(&counters);
+}
+
+static void bench_write(struct marshal_case *c, uint64_t iterations) {
+  struct bench_counters counters;
+  char buffer[CAP];
+  size_t offset = 0;
+
+  bench_counters_open(&counters);
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    offset = 0;
+    xdwl_write_args(buffer, &offset, c->args, c->arg_count, c->signature);
+  }
+
+  uint64_t ns = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  sink = offset;
+
+  char extra[32];
+  snprintf(extra, sizeof(extra), "\"bytes\": %zu", offset);
+  bench_json_result("write_args", c->variant, iterations, ns, &counters,
+                    extra);
+  bench_counters_close(&counters);
+}
+
+static void bench_read(struct marshal_case *c, uint64_t iterations) {
+  struct bench_counters counters;
+  char buffer[CAP];
+  size_t offset = 0;
+  xdwl_arg args[c->arg_count + 1];
+
+  xdwl_write_args(buffer, &offset, c->args, c->arg_count, c->signature);
+
+  struct xdwl_raw_message message = {0, 0, offset, buffer, -1};
+
+  bench_counters_open(&counters);
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+
+  for (uint64_t i = 0; i < iterations; i++)
+    xdwl_read_args(&message, args, c->signature);
+
+  uint64_t ns = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  sink = args[1].u;
+
+  bench_json_result("read_args", c->variant, iterations, ns, &counters, NULL);
+  bench_counters_close(&counters);
+}
+
+// the whole request path down to sendmsg, with a thread emptying the other
+// end so the socket never fills up
+static int bench_send(struct marshal_case *c, uint64_t iterations) {
+  struct bench_counters counters;
+  int fds[2];
+  pthread_t drainer;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+    perror("socketpair");
+    return -1;
+  }
+
+  xdwl_proxy *proxy = xdwl_proxy_create_from_fd(fds[0]);
+  if (!proxy) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  xdwl_id id = 0;
+  if (xdwl_object_register(proxy, 1, "wl_display") == 1)
+    id = xdwl_object_register(proxy, 0, c->interface);
+
+  if (id == 0 || pthread_create(&drainer, NULL, drain, &fds[1]) != 0) {
+    xdwl_proxy_destroy(proxy);
+    close(fds[1]);
+    return -1;
+  }
+
+  int ret = 0;
+
+  bench_counters_open(&counters);
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (c->send(proxy, id, c->args) == -1) {
+      ret = -1;
+      break;
+    }
+  }
+
+  uint64_t ns = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+
+  if (ret == 0)
+    bench_json_result("send_request", c->variant, iterations, ns, &counters,
+                      NULL);
+  bench_counters_close(&counters);
+
+  // the drainer sees eof once the proxy closes its end
+  xdwl_proxy_destroy(proxy);
+  pthread_join(drainer, NULL);
+  close(fds[1]);
+
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t iterations = DEFAULT_ITERATIONS;
+
+  if (argc > 1) {
+    iterations = strtoull(argv[1], NULL, 10);
+    if (iterations == 0) {
+      fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  char long_string[LONG_STRING_LENGTH + 1];
+  memset(long_string, 'x', LONG_STRING_LENGTH);
+  long_string[LONG_STRING_LENGTH] = '\0';
+
+  // never read, it only has to be a valid fd to pass
+  int pool_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (pool_fd == -1) {
+    perror("open");
+    return 1;
+  }
+
+  struct marshal_case cases[] = {
+      {"uuii", "wl_pointer", "uuii", 4,
+       {{.u = 1234}, {.u = 7}, {.i = 4}, {.i = 4}}, send_set_cursor},
+      {"uiiiiu", "wl_shm_pool", "uiiiiu", 6,
+       {{.u = 9}, {.i = 0}, {.i = 1920}, {.i = 1080}, {.i = 7680}, {.u = 0}},
+       send_create_buffer},
+      {"s", "wl_data_source", "s", 1,
+       {{.s = "text/plain;charset=utf-8"}}, send_offer},
+      {"s_long", "wl_shell_surface", "s", 1, {{.s = long_string}},
+       send_set_title},
+      {"uhi", "wl_shm", "uhi", 3, {{.u = 9}, {.fd = pool_fd}, {.i = 4096}},
+       send_create_pool},
+  };
+  size_t case_count = sizeof(cases) / sizeof(cases[0]);
+
+  bench_json_begin("marshal");
+
+  for (size_t i = 0; i < case_count; i++) {
+    warm_up(&cases[i], iterations / 10 + 1);
+
+    bench_body_size(&cases[i], iterations);
+    bench_write(&cases[i], iterations);
+    bench_read(&cases[i], iterations);
+
+    if (bench_send(&cases[i], iterations / 10 + 1) == -1) {
+      xdwl_error_print();
+      close(pool_fd);
+      return 1;
+    }
+  }
+
+  bench_json_end();
+  close(pool_fd);
+
+  return 0;
+}
@@ -0,0 +1,286 @@
+#include "xdwayland-bench.h"
+#include "xdwayland-client.h"
+#include "xdwayland-core.h"
+#include "xdwayland-globals.h"
+#include "xdwayland-mock.h"
+#include "xdwayland-stats.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define DEFAULT_ITERATIONS 200
+
+// what a screenshot or clipboard tool binds before doing anything
+static const struct xdwl_global_want wants[] = {
+    {"wl_compositor", 4},
+    {"wl_shm", 1},
+    {"wl_seat", 7},
+    {"wl_output", 3},
+    {"wl_data_device_manager", 3},
+};
+static const size_t want_count = sizeof(wants) / sizeof(wants[0]);
+
+// offsets from the parent's timestamp right before fork, so exec and
+// dynamic linking are part of it
+struct startup_times {
+  uint64_t main_ns;
+  uint64_t connected_ns;
+  uint64_t ready_ns; // every wanted global is bound
+  uint64_t send_calls;
+};
+
+static xdwl_proxy *proxy;
+static xdwl_id registry_id;
+
+static void bind_wanted(void *data, xdwl_arg *args) {
+  for (size_t i = 0; i < want_count; i++) {
+    if (strcmp(args[2].s, wants[i].interface) != 0 ||
+        xdwl_object_get_by_name(proxy, wants[i].interface))
+      continue;
+
+    uint32_t version =
+        args[3].u < wants[i].version ? args[3].u : wants[i].version;
+    xdwl_id id = xdwl_object_register(proxy, 0, wants[i].interface);
+
+    if (id == 0 || xdwl_registry_bind(proxy, registry_id, args[1].u,
+                                      args[2].s, version, id) == -1)
+      xdwl_error_print();
+  }
+}
+
+// what most clients do: bind from the global handler as events come in.
+// ready once the roundtrip is back and every bind is sent, the same point
+// xdwl_globals_fetch returns at
+static int connect_classic() {
+  registry_id = xdwl_object_register(proxy, 0, "wl_registry");
+  struct xdwl_registry_event_handlers registry = {.global = bind_wanted};
+
+  if (registry_id == 0 || xdwl_registry_add_listener(proxy, &registry, NULL) ||
+      xdwl_display_get_registry(proxy, registry_id) == -1)
+    return -1;
+
+  return xdwl_roundtrip(proxy);
+}
+
+static int connect_fast() {
+  struct xdwl_globals globals;
+
+  if (xdwl_globals_fetch(proxy, wants, want_count, &globals) == -1)
+    return -1;
+
+  xdwl_globals_release(&globals);
+  return 0;
+}
+
+static int child(const char *variant, int fd, int out, uint64_t start) {
+  struct startup_times times;
+  struct xdwl_stats stats;
+
+  times.main_ns = bench_now_ns() - start;
+
+  proxy = xdwl_proxy_create_from_fd(fd);
+  if (!proxy || xdwl_object_register(proxy, 1, "wl_display") != 1)
+    return 1;
+  times.connected_ns = bench_now_ns() - start;
+
+  int r = strcmp(variant, "fast") == 0 ? connect_fast() : connect_classic();
+  times.ready_ns = bench_now_ns() - start;
+
+  if (r == -1 || xdwl_proxy_get_stats(proxy, &stats) == -1) {
+    xdwl_error_print();
+    return 1;
+  }
+  times.send_calls = stats.io.send_calls;
+  xdwl_stats_release(&stats);
+
+  xdwl_proxy_destroy(proxy);
+
+  return write(out, &times, sizeof(times)) != sizeof(times);
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint64_t *samples, size_t count, size_t p) {
+  qsort(samples, count, sizeof(uint64_t), compare_u64);
+  return samples[(count - 1) * p / 100];
+}
+
+// one fresh process and mock per iteration, the child inherits its end of
+// the mock's socket and a pipe to report on
+static int spawn(const char *self, const char *variant,
+                 struct startup_times *times) {
+  struct xdwl_mock *mock = xdwl_mock_create();
+  int pipe_fds[2];
+
+  if (!mock)
+    return -1;
+
+  if (xdwl_mock_add_global(mock, "wl_compositor", 4) == 0 ||
+      xdwl_mock_add_global(mock, "wl_subcompositor", 1) == 0 ||
+      xdwl_mock_add_global(mock, "wl_shm", 1) == 0 ||
+      xdwl_mock_add_global(mock, "wl_seat", 7) == 0 ||
+      xdwl_mock_add_global(mock, "wl_output", 3) == 0 ||
+      xdwl_mock_add_global(mock, "wl_data_device_manager", 3) == 0 ||
+      xdwl_mock_add_global(mock, "xdg_wm_base", 5) == 0 ||
+      xdwl_mock_add_global(mock, "zwp_linux_dmabuf_v1", 4) == 0) {
+    xdwl_mock_destroy(mock);
+    return -1;
+  }
+
+  int fd = xdwl_mock_get_client_fd(mock);
+  if (pipe(pipe_fds) == -1) {
+    perror("pipe");
+    close(fd);
+    xdwl_mock_destroy(mock);
+    return -1;
+  }
+
+  char fd_arg[16], out_arg[16], start_arg[32];
+  snprintf(fd_arg, sizeof(fd_arg), "%d", fd);
+  snprintf(out_arg, sizeof(out_arg), "%d", pipe_fds[1]);
+
+  uint64_t start = bench_now_ns();
+  snprintf(start_arg, sizeof(start_arg), "%lu", start);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    fcntl(fd, F_SETFD, 0);
+    close(pipe_fds[0]);
+    execl(self, self, "-C", variant, fd_arg, out_arg, start_arg, NULL);
+    perror("execl");
+    _exit(1);
+  }
+
+  close(fd);
+  close(pipe_fds[1]);
+
+  int status = 1;
+  ssize_t n = pid == -1 ? -1 : read(pipe_fds[0], times, sizeof(*times));
+  if (pid != -1)
+    waitpid(pid, &status, 0);
+  else
+    perror("fork");
+
+  close(pipe_fds[0]);
+  xdwl_mock_destroy(mock);
+
+  return n == sizeof(*times) && WIFEXITED(status) &&
+                 WEXITSTATUS(status) == 0
+             ? 0
+             : -1;
+}
+
+static int bench_startup(const char *self, const char *variant,
+                         uint64_t iterations) {
+  uint64_t *main_ns = malloc(iterations * sizeof(uint64_t));
+  uint64_t *connected_ns = malloc(iterations * sizeof(uint64_t));
+  uint64_t *ready_ns = malloc(iterations * sizeof(uint64_t));
+  uint64_t *globals_ns = malloc(iterations * sizeof(uint64_t));
+  uint64_t total = 0, send_calls = 0;
+  int r = 0;
+
+  if (!main_ns || !connected_ns || !ready_ns || !globals_ns) {
+    perror("malloc");
+    r = -1;
+  }
+
+  for (uint64_t i = 0; i < iterations && r == 0; i++) {
+    struct startup_times times;
+
+    if (spawn(self, variant, &times) == -1) {
+      fprintf(stderr, "%s: iteration %lu failed\n", variant, i);
+      r = -1;
+      break;
+    }
+
+    main_ns[i] = times.main_ns;
+    connected_ns[i] = times.connected_ns;
+    ready_ns[i] = times.ready_ns;
+    globals_ns[i] = times.ready_ns - times.connected_ns;
+    send_calls = times.send_calls;
+    total += times.ready_ns;
+  }
+
+  if (r == 0) {
+    // exec and linking swamp the rest, globals is the part the library
+    // decides
+    char extra[320];
+    snprintf(extra, sizeof(extra),
+             "\"main_p50_ns\": %lu, \"connected_p50_ns\": %lu, "
+             "\"ready_p50_ns\": %lu, \"ready_p99_ns\": %lu, "
+             "\"globals_p50_ns\": %lu, \"globals_p99_ns\": %lu, "
+             "\"send_calls\": %lu",
+             percentile(main_ns, iterations, 50),
+             percentile(connected_ns, iterations, 50),
+             percentile(ready_ns, iterations, 50),
+             percentile(ready_ns, iterations, 99),
+             percentile(globals_ns, iterations, 50),
+             percentile(globals_ns, iterations, 99), send_calls);
+    bench_json_result("startup", variant, iterations, total, NULL, extra);
+  }
+
+  free(main_ns);
+  free(connected_ns);
+  free(ready_ns);
+  free(globals_ns);
+
+  return r;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-n iterations]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t iterations = DEFAULT_ITERATIONS;
+  int opt;
+
+  // the spawned side: -C variant fd out start
+  if (argc == 6 && strcmp(argv[1], "-C") == 0)
+    return child(argv[2], atoi(argv[3]), atoi(argv[4]),
+                 strtoull(argv[5], NULL, 10));
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = strtoull(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (iterations == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // argv[0] may not be a path, the kernel always knows
+  char self[4096];
+  ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (length == -1) {
+    perror("readlink");
+    return 1;
+  }
+  self[length] = '\0';
+
+  int ret = 0;
+
+  bench_json_begin("startup");
+
+  if (bench_startup(self, "classic", iterations) == -1 ||
+      bench_startup(self, "fast", iterations) == -1)
+    ret = 1;
+
+  bench_json_end();
+
+  if (ret)
+    xdwl_error_print();
+
+  return ret;
+}
@@ -0,0 +1,143 @@
+#ifndef XDWAYLAND_BENCH_H
+#define XDWAYLAND_BENCH_H
+
+// shared by the benchmark executables: timing, hardware counters and the
+// json they all print. results go to stdout, everything else to stderr
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_COUNTERS 4
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} bench_events[BENCH_COUNTERS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// one group per benchmark, counting the calling thread in user space only
+// so it works with the default perf_event_paranoid. the group is scheduled
+// as a whole, so the ratios come from the same time slices. fds stay -1
+// when the kernel or the vm doesn't expose a counter
+struct bench_counters {
+  int leader; // first counter that opened, -1 if none did
+  int fds[BENCH_COUNTERS];
+  uint64_t values[BENCH_COUNTERS];
+};
+
+static inline uint64_t bench_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void bench_counters_open(struct bench_counters *c) {
+  c->leader = -1;
+
+  for (size_t i = 0; i < BENCH_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    int group_fd = c->leader >= 0 ? c->fds[c->leader] : -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = bench_events[i].type;
+    attr.config = bench_events[i].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // members follow the leader being enabled and disabled
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    c->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+    c->values[i] = 0;
+
+    if (c->fds[i] >= 0 && c->leader < 0)
+      c->leader = i;
+  }
+}
+
+static inline void bench_counters_close(struct bench_counters *c) {
+  for (size_t i = 0; i < BENCH_COUNTERS; i++) {
+    if (c->fds[i] >= 0)
+      close(c->fds[i]);
+  }
+}
+
+static inline void bench_counters_start(struct bench_counters *c) {
+  if (c->leader < 0)
+    return;
+
+  ioctl(c->fds[c->leader], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(c->fds[c->leader], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static inline void bench_counters_stop(struct bench_counters *c) {
+  // the count, then a value per counter in the order they joined
+  uint64_t group[1 + BENCH_COUNTERS];
+
+  if (c->leader < 0)
+    return;
+
+  ioctl(c->fds[c->leader], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  if (read(c->fds[c->leader], group, sizeof(group)) < (ssize_t)sizeof(uint64_t))
+    group[0] = 0;
+
+  for (size_t i = 0, n = 0; i < BENCH_COUNTERS; i++) {
+    if (c->fds[i] < 0)
+      continue;
+
+    c->values[i] = n < group[0] ? group[1 + n] : 0;
+    n++;
+  }
+}
+
+static int bench_results = 0;
+
+static inline void bench_json_begin(const char *suite) {
+  printf("{\n  \"suite\": \"%s\",\n  \"results\": [", suite);
+  bench_results = 0;
+}
+
+static inline void bench_json_end() { printf("\n  ]\n}\n"); }
+
+// counters are per message, null when unavailable. extra is more json
+// members, without the leading comma, or NULL
+static inline void bench_json_result(const char *name, const char *variant,
+                              uint64_t iterations, uint64_t ns,
+                              const struct bench_counters *c,
+                              const char *extra) {
+  double per_op = iterations ? (double)ns / iterations : 0;
+
+  printf("%s\n    {\"name\": \"%s\", \"variant\": \"%s\", "
+         "\"iterations\": %lu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f",
+         bench_results++ ? "," : "", name, variant, iterations, per_op,
+         per_op > 0 ? 1e9 / per_op : 0);
+
+  for (size_t i = 0; c && i < BENCH_COUNTERS; i++) {
+    if (c->fds[i] < 0)
+      printf(", \"%s\": null", bench_events[i].name);
+    else
+      printf(", \"%s\": %.2f", bench_events[i].name,
+             (double)c->values[i] / iterations);
+  }
+
+  if (extra)
+    printf(", %s", extra);
+
+  printf("}");
+  fflush(stdout);
+}
+
+#endif
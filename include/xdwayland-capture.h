@@ -0,0 +1,76 @@
+#ifndef XDWAYLAND_CAPTURE_H
+#define XDWAYLAND_CAPTURE_H
+
+#include "xdwayland-types.h"
+
+#define XDWL_CAPTURE_MAGIC "XDWLCAP1"
+
+// the most a single record carries, a full input buffer
+#define XDWL_CAPTURE_MAX_RECORD (1 << 16)
+
+// a capture file is this header followed by records, each a record header
+// and length bytes exactly as one send or recv moved them. received bytes
+// keep the original split, so a message can span two records. all fields
+// are in host byte order
+struct xdwl_capture_header {
+  char magic[8];
+  uint64_t start_ns; // CLOCK_REALTIME when the capture started
+};
+
+enum xdwl_capture_direction {
+  XDWL_CAPTURE_SENT,
+  XDWL_CAPTURE_RECEIVED,
+};
+
+struct xdwl_capture_record {
+  uint64_t time_ns; // since the capture started
+  uint32_t length;
+  uint8_t direction;
+  uint8_t fd_count; // only how many, the fds themselves aren't kept
+  uint16_t reserved;
+};
+
+// everything the proxy sends and receives from now on goes to path,
+// truncating it. XDWL_CAPTURE=path does the same for every proxy
+// xdwl_proxy_create connects
+XDWL_MUST_CHECK int xdwl_capture_start(xdwl_proxy *proxy, const char *path);
+void xdwl_capture_stop(xdwl_proxy *proxy);
+
+// 1 with the header filled in, 0 if file isn't a capture
+XDWL_MUST_CHECK int xdwl_capture_read_header(FILE *file,
+                                             struct xdwl_capture_header *header);
+// 1 with record and payload filled in, 0 at the end of the file, -1 on an
+// oversized or truncated record. payload needs XDWL_CAPTURE_MAX_RECORD
+// bytes
+XDWL_MUST_CHECK int xdwl_capture_read(FILE *file,
+                                      struct xdwl_capture_record *record,
+                                      char *payload);
+
+enum xdwl_replay_mode {
+  XDWL_REPLAY_FAST,  // as fast as dispatch goes
+  XDWL_REPLAY_TIMED, // received records at their original offsets
+};
+
+// feeds the received side of a capture through the dispatch path of its
+// own proxy, no compositor needed. register the objects and listeners of
+// interest before running it, events for objects that don't exist are
+// skipped. requests sent from handlers go nowhere, and nothing that waits
+// for the server (xdwl_roundtrip) works
+struct xdwl_replay {
+  xdwl_proxy *proxy;
+  FILE *file;
+  int peer_fd; // other end of the proxy's socket, emptied after each record
+  struct xdwl_capture_header header;
+  uint64_t records;
+  uint64_t bytes;
+  uint64_t skipped; // messages for objects that weren't registered
+};
+
+XDWL_MUST_CHECK struct xdwl_replay *xdwl_replay_create(const char *path);
+void xdwl_replay_destroy(struct xdwl_replay *replay);
+
+// until the end of the capture or the first dispatch error
+XDWL_MUST_CHECK int xdwl_replay_run(struct xdwl_replay *replay,
+                                    enum xdwl_replay_mode mode);
+
+#endif
@@ -11,8 +11,24 @@ int xdwl_add_listener(xdwl_proxy *proxy, const char *object_name,
                       void *user_data);
 
 xdwl_proxy *xdwl_proxy_create();
+// takes over an already connected socket, closed by xdwl_proxy_destroy
+xdwl_proxy *xdwl_proxy_create_from_fd(int fd);
+// the proxy and everything it owns are allocated through allocator, which
+// is copied. per subsystem usage shows up in xdwl_proxy_get_stats
+xdwl_proxy *
+xdwl_proxy_create_with_allocator(const struct xdwl_allocator *allocator);
+xdwl_proxy *
+xdwl_proxy_create_from_fd_with_allocator(int fd,
+                                         const struct xdwl_allocator *allocator);
 void xdwl_proxy_destroy(xdwl_proxy *proxy);
 
+// while corked, requests without an fd are queued and go out in one write
+// on xdwl_proxy_flush, xdwl_proxy_uncork, or before the proxy blocks
+// waiting for events. a request with an fd flushes the queue
+void xdwl_proxy_cork(xdwl_proxy *proxy);
+XDWL_MUST_CHECK int xdwl_proxy_uncork(xdwl_proxy *proxy);
+XDWL_MUST_CHECK int xdwl_proxy_flush(xdwl_proxy *proxy);
+
 XDWL_MUST_CHECK int xdwl_roundtrip(xdwl_proxy *proxy);
 XDWL_MUST_CHECK int xdwl_dispatch(xdwl_proxy *proxy);
 
@@ -4,24 +4,79 @@
 #include "xdwayland-types.h"
 #include <stdio.h>
 
-#define xdwl_list_for_each(pos, member)                             \
-  for (; pos->next && ((member = pos->data), 1); pos = pos->next) 	\
+#define xdwl_container_of(ptr, type, member)                        \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
 
+#define xdwl_ilist_for_each(pos, l)                                 \
+  for ((pos) = (l)->head.next; (pos) != &(l)->tail; (pos) = (pos)->next)
+
+// pos may be removed from the list inside the loop body
+#define xdwl_ilist_for_each_safe(pos, tmp, l)                       \
+  for ((pos) = (l)->head.next, (tmp) = (pos)->next; (pos) != &(l)->tail; \
+       (pos) = (tmp), (tmp) = (pos)->next)
+
+#define xdwl_list_for_each(l, member)                               \
+  for (struct xdwl_link *__link = (l)->items.head.next;             \
+       __link != &(l)->items.tail &&                                \
+       ((member = (void *)xdwl_container_of(__link, struct xdwl_list_node, \
+                                            link)->data), 1);       \
+       __link = __link->next)
+
+#define XDWL_MAP_DEFAULT_MAX_LOAD 0.85f
+
+#define xdwl_map_slot(slots, stride, i)                             \
+  ((struct xdwl_map_pair *)((slots) + (i) * (stride)))
+
+// finishes a pending rehash first, so every pair lives in m->slots. that
+// moves pairs, so nothing else may be walking or holding into the map
 #define xdwl_map_for_each(m, p)                                     \
-  for (size_t __i = 0; __i < (m)->size; __i++)                      \
-    for ((p) = (m)->pairs[__i]; (p) != NULL; (p) = (p)->next)
+  for (size_t __i = (xdwl_map_flush(m), 0);                         \
+       (m)->slots && __i < (m)->size; __i++)                        \
+    if (((p) = xdwl_map_slot((m)->slots, (m)->stride, __i))->distance)
 
 xdwl_map *xdwl_map_new(size_t size);
 void xdwl_map_destroy(xdwl_map *m);
+void xdwl_map_set_max_load(xdwl_map *m, float max_load);
+void xdwl_map_flush(xdwl_map *m);
+// returned slots live inside the table. any later set, insert or remove
+// can move them, so a pointer is only good until the next one of those.
+// the first insert fixes the value size, bigger values are rejected after
+
+// insert or replace, returns the slot holding the copied value
 XDWL_MUST_CHECK void *xdwl_map_set(xdwl_map *m, size_t key, void *value,
                                    size_t value_size);
 XDWL_MUST_CHECK void *xdwl_map_set_str(xdwl_map *m, const char *key_str,
                                        void *value, size_t value_size);
+// returns the existing slot, or a zeroed new one with *inserted set to 1
+XDWL_MUST_CHECK void *xdwl_map_get_or_insert(xdwl_map *m, size_t key,
+                                             size_t value_size, int *inserted);
+XDWL_MUST_CHECK void *xdwl_map_get_or_insert_str(xdwl_map *m,
+                                                 const char *key_str,
+                                                 size_t value_size,
+                                                 int *inserted);
 void xdwl_map_remove(xdwl_map *m, size_t key);
 void xdwl_map_remove_str(xdwl_map *m, const char *key_str);
+// doesn't move anything, but the slot is only good until the next set or
+// remove like the ones above
 void *xdwl_map_get(xdwl_map *m, size_t key);
 void *xdwl_map_get_str(xdwl_map *m, const char *key_str);
 
+// interned strings live until exit and compare equal by pointer, so a
+// handle can be used directly as an xdwl_map key, same as the _str variants
+XDWL_MUST_CHECK const char *xdwl_intern(const char *string);
+XDWL_MUST_CHECK const char *xdwl_intern_lookup(const char *string);
+size_t xdwl_intern_hash(const char *interned);
+
+void xdwl_ilist_init(xdwl_ilist *l);
+void xdwl_ilist_push(xdwl_ilist *l, struct xdwl_link *link);
+void xdwl_ilist_push_front(xdwl_ilist *l, struct xdwl_link *link);
+void xdwl_ilist_insert_after(xdwl_ilist *l, struct xdwl_link *pos,
+                             struct xdwl_link *link);
+void xdwl_ilist_remove(xdwl_ilist *l, struct xdwl_link *link);
+void xdwl_ilist_splice(xdwl_ilist *dst, xdwl_ilist *src);
+struct xdwl_link *xdwl_ilist_first(xdwl_ilist *l);
+struct xdwl_link *xdwl_ilist_last(xdwl_ilist *l);
+
 xdwl_list *xdwl_list_new();
 void xdwl_list_destroy(xdwl_list *l);
 XDWL_MUST_CHECK void *xdwl_list_push(xdwl_list *l, void *data,
@@ -30,10 +85,15 @@ void xdwl_list_remove(xdwl_list **head, size_t n);
 XDWL_MUST_CHECK void *xdwl_list_get(xdwl_list *l, size_t n);
 size_t xdwl_list_len(xdwl_list *l);
 
+xdwl_pool *xdwl_pool_new(size_t item_size, size_t items_per_slab);
+void xdwl_pool_destroy(xdwl_pool *p);
+XDWL_MUST_CHECK void *xdwl_pool_alloc(xdwl_pool *p);
+void xdwl_pool_free(xdwl_pool *p, void *item);
+
 xdwl_bitmap *xdwl_bitmap_new(uint32_t limit);
 void xdwl_bitmap_destroy(xdwl_bitmap *bm);
 XDWL_MUST_CHECK int xdwl_bitmap_set(xdwl_bitmap *bm, uint32_t n);
-XDWL_MUST_CHECK uint8_t xdwl_bitmap_get(xdwl_bitmap *bm, uint32_t n);
+XDWL_MUST_CHECK int xdwl_bitmap_get(xdwl_bitmap *bm, uint32_t n);
 XDWL_MUST_CHECK uint32_t xdwl_bitmap_get_free(xdwl_bitmap *bm);
 XDWL_MUST_CHECK int xdwl_bitmap_unset(xdwl_bitmap *bm, uint32_t n);
 
@@ -0,0 +1,32 @@
+#ifndef XDWAYLAND_DAMAGE_H
+#define XDWAYLAND_DAMAGE_H
+
+#include "xdwayland-types.h"
+
+#define XDWL_DAMAGE_MAX_RECTS 16
+
+// rects never overlap or touch each other, adding one merges it with every
+// rect it meets. past max_rects everything collapses to the bounding box
+struct xdwl_damage {
+  size_t count;
+  size_t max_rects;
+  struct xdwl_rect rects[XDWL_DAMAGE_MAX_RECTS];
+};
+
+void xdwl_damage_init(struct xdwl_damage *damage, size_t max_rects);
+void xdwl_damage_clear(struct xdwl_damage *damage);
+void xdwl_damage_add(struct xdwl_damage *damage, int32_t x, int32_t y,
+                     int32_t width, int32_t height);
+void xdwl_damage_add_damage(struct xdwl_damage *damage,
+                            const struct xdwl_damage *other);
+struct xdwl_rect xdwl_damage_extents(const struct xdwl_damage *damage);
+
+// sends one wl_surface.damage_buffer per rect and clears the damage
+XDWL_MUST_CHECK int xdwl_damage_flush(xdwl_proxy *proxy, xdwl_id wl_surface_id,
+                                      struct xdwl_damage *damage);
+// flush followed by wl_surface.commit
+XDWL_MUST_CHECK int xdwl_damage_commit(xdwl_proxy *proxy,
+                                       xdwl_id wl_surface_id,
+                                       struct xdwl_damage *damage);
+
+#endif
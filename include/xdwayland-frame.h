@@ -0,0 +1,57 @@
+#ifndef XDWAYLAND_FRAME_H
+#define XDWAYLAND_FRAME_H
+
+#include "xdwayland-types.h"
+
+#define XDWL_FRAME_HISTOGRAM_BUCKETS 32
+
+// bucket i counts intervals of [2^i, 2^(i+1)) microseconds, bucket 0 also
+// takes everything under a microsecond
+struct xdwl_frame_histogram {
+  uint64_t buckets[XDWL_FRAME_HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+};
+
+struct xdwl_frame_scheduler;
+
+// draws the frame and commits the surface, the frame callback for the next
+// one is already part of that commit. time is the done timestamp in
+// milliseconds, 0 for a frame that didn't wait for a callback
+typedef void(xdwl_frame_handler)(void *, struct xdwl_frame_scheduler *,
+                                 uint32_t);
+
+struct xdwl_frame_scheduler {
+  xdwl_proxy *proxy;
+  xdwl_id surface_id;
+  xdwl_id callback_id; // pending wl_callback, 0 while idle
+  uint8_t dirty;
+  xdwl_frame_handler *redraw;
+  void *user_data;
+
+  uint64_t callback_time; // monotonic ns of the last done
+  uint64_t commit_time;   // monotonic ns the last redraw returned
+  uint64_t frames;
+  uint64_t skipped; // callbacks that found nothing to draw
+  struct xdwl_frame_histogram callback_to_commit;
+  struct xdwl_frame_histogram commit_to_callback;
+};
+
+XDWL_MUST_CHECK struct xdwl_frame_scheduler *
+xdwl_frame_scheduler_create(xdwl_proxy *proxy, xdwl_id wl_surface_id,
+                            xdwl_frame_handler *redraw, void *user_data);
+void xdwl_frame_scheduler_destroy(struct xdwl_frame_scheduler *scheduler);
+
+// marks the surface dirty. an idle surface is redrawn right away, otherwise
+// the redraw waits for the pending frame callback. scheduling several times
+// before that still draws a single frame
+XDWL_MUST_CHECK int
+xdwl_frame_scheduler_schedule(struct xdwl_frame_scheduler *scheduler);
+
+void xdwl_frame_scheduler_reset_stats(struct xdwl_frame_scheduler *scheduler);
+// upper bound in microseconds of the bucket holding the given percentile
+uint64_t xdwl_frame_histogram_percentile(const struct xdwl_frame_histogram *h,
+                                         double percentile);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef XDWAYLAND_GLOBALS_H
+#define XDWAYLAND_GLOBALS_H
+
+#include "xdwayland-types.h"
+
+struct xdwl_global {
+  uint32_t name;
+  const char *interface; // interned
+  uint32_t version;
+  xdwl_id id; // the bound object, 0 if it wasn't wanted
+};
+
+struct xdwl_global_want {
+  const char *interface;
+  uint32_t version; // the newest the client speaks, bound at most at that
+};
+
+struct xdwl_globals {
+  xdwl_id registry_id;
+  size_t count;
+  struct xdwl_global *globals; // in the order the server announced them
+};
+
+// the registry and the wanted globals in a single roundtrip, for clients
+// that mostly start up and exit. get_registry and the sync go out in one
+// write, the first global of each wanted interface is bound from its
+// global event and the binds go out together once the sync is done.
+// bound objects are registered under their interface names. wl_display
+// must be registered already, the registry's listener belongs to this
+// until it returns. on failure the requests it still had queued are
+// dropped and their ids freed, a registry or bind the server already got
+// stays registered
+XDWL_MUST_CHECK int xdwl_globals_fetch(xdwl_proxy *proxy,
+                                       const struct xdwl_global_want *wants,
+                                       size_t want_count,
+                                       struct xdwl_globals *globals);
+
+// the first global of that interface, NULL if the server has none
+const struct xdwl_global *xdwl_globals_find(const struct xdwl_globals *globals,
+                                            const char *interface);
+
+void xdwl_globals_release(struct xdwl_globals *globals);
+
+#endif
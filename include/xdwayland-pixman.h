@@ -0,0 +1,41 @@
+#ifndef XDWAYLAND_PIXMAN_H
+#define XDWAYLAND_PIXMAN_H
+
+#include "xdwayland-types.h"
+
+// 32 bits per pixel wl_shm formats only: ARGB8888, XRGB8888, ABGR8888 and
+// XBGR8888. alpha formats are expected to hold premultiplied pixels
+struct xdwl_image {
+  void *data;
+  int32_t width;
+  int32_t height;
+  int32_t stride;
+  uint32_t format;
+};
+
+enum xdwl_pixman_impl {
+  XDWL_PIXMAN_SCALAR = 0,
+  XDWL_PIXMAN_SSE2,
+  XDWL_PIXMAN_AVX2,
+};
+
+// picked from the cpu on load, can be forced down for testing
+enum xdwl_pixman_impl xdwl_pixman_get_impl();
+XDWL_MUST_CHECK int xdwl_pixman_set_impl(enum xdwl_pixman_impl impl);
+
+// rects are clipped to the images. color is in the image's own format
+void xdwl_pixman_fill(struct xdwl_image *image, struct xdwl_rect rect,
+                      uint32_t color);
+void xdwl_pixman_premultiply(struct xdwl_image *image, struct xdwl_rect rect);
+
+// rect is in src, the result lands at dst_x, dst_y
+void xdwl_pixman_copy(struct xdwl_image *dst, int32_t dst_x, int32_t dst_y,
+                      const struct xdwl_image *src, struct xdwl_rect rect);
+void xdwl_pixman_over(struct xdwl_image *dst, int32_t dst_x, int32_t dst_y,
+                      const struct xdwl_image *src, struct xdwl_rect rect);
+XDWL_MUST_CHECK int xdwl_pixman_convert(struct xdwl_image *dst, int32_t dst_x,
+                                        int32_t dst_y,
+                                        const struct xdwl_image *src,
+                                        struct xdwl_rect rect);
+
+#endif
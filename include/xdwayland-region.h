@@ -0,0 +1,43 @@
+#ifndef XDWAYLAND_REGION_H
+#define XDWAYLAND_REGION_H
+
+#include "xdwayland-types.h"
+
+#define XDWL_REGION_CACHE_DEFAULT_SIZE 16
+
+struct xdwl_region_entry {
+  struct xdwl_link link;            // lru, most recently used first
+  struct xdwl_region_entry *next;   // same hash, different rects
+  size_t hash;
+  xdwl_id region_id;
+  size_t count;
+  struct xdwl_rect rects[];
+};
+
+// wl_regions keyed by their contents: the same rects in the same order get
+// the same region back. past capacity the least recently used one is
+// destroyed and its id may be handed out again for different rects, so
+// keep capacity above the number of regions in use at once
+struct xdwl_region_cache {
+  xdwl_proxy *proxy;
+  xdwl_id compositor_id;
+  size_t capacity;
+  xdwl_ilist lru;
+  xdwl_map *entries; // hash to the first entry with it
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+XDWL_MUST_CHECK struct xdwl_region_cache *
+xdwl_region_cache_create(xdwl_proxy *proxy, xdwl_id wl_compositor_id,
+                         size_t capacity);
+void xdwl_region_cache_destroy(struct xdwl_region_cache *cache);
+
+// a region holding the union of rects, created with wl_region.add on a
+// miss. returns 0 on failure
+XDWL_MUST_CHECK xdwl_id xdwl_region_cache_get(struct xdwl_region_cache *cache,
+                                              const struct xdwl_rect *rects,
+                                              size_t count);
+
+#endif
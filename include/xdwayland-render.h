@@ -0,0 +1,49 @@
+#ifndef XDWAYLAND_RENDER_H
+#define XDWAYLAND_RENDER_H
+
+#include "xdwayland-damage.h"
+#include "xdwayland-pixman.h"
+#include "xdwayland-swapchain.h"
+#include "xdwayland-types.h"
+
+// 64x64 pixels at 4 bytes each is 16KiB, a tile and its source data fit in
+// L2 on anything recent
+#define XDWL_RENDER_DEFAULT_TILE_SIZE 64
+#define XDWL_RENDER_MAX_THREADS 64
+
+// called from any worker thread, possibly several at once on different
+// tiles. rect is already clipped to the damage inside the tile, only pixels
+// inside it may be written
+typedef void(xdwl_tile_renderer)(void *, struct xdwl_image *,
+                                 struct xdwl_rect);
+
+struct xdwl_renderer;
+
+// thread_count counts the calling thread, which renders too. 0 picks one
+// per online cpu, 1 renders everything on the caller without spawning
+XDWL_MUST_CHECK struct xdwl_renderer *xdwl_renderer_create(size_t thread_count,
+                                                           int32_t tile_size);
+void xdwl_renderer_destroy(struct xdwl_renderer *renderer);
+
+// renders every tile touched by damage (the whole image if damage is NULL)
+// and returns once all of them are done. the rendered rects are added to
+// out_damage, which may be NULL
+XDWL_MUST_CHECK int xdwl_renderer_draw(struct xdwl_renderer *renderer,
+                                       struct xdwl_image *image,
+                                       const struct xdwl_damage *damage,
+                                       xdwl_tile_renderer *render,
+                                       void *user_data,
+                                       struct xdwl_damage *out_damage);
+
+// draws damage plus whatever buffer missed since it was last shown (see
+// xdwl_swapchain_copy_forward to skip the latter), then attaches it, sends
+// the rendered damage, commits and submits it to its swapchain. NULL damage
+// redraws everything
+XDWL_MUST_CHECK int
+xdwl_renderer_present(struct xdwl_renderer *renderer, xdwl_proxy *proxy,
+                      xdwl_id wl_surface_id,
+                      struct xdwl_swapchain_buffer *buffer,
+                      const struct xdwl_damage *damage,
+                      xdwl_tile_renderer *render, void *user_data);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef XDWAYLAND_SHM_H
+#define XDWAYLAND_SHM_H
+
+#include "xdwayland-types.h"
+
+enum xdwl_shm_flags {
+  // fault the whole pool in when it's mapped or grown, instead of one page
+  // at a time the first time each buffer is drawn to
+  XDWL_SHM_POPULATE = 1 << 0,
+  // back the pool with hugetlbfs pages when some are reserved, otherwise
+  // ask for transparent huge pages
+  XDWL_SHM_HUGEPAGE = 1 << 1,
+  // seal the memfd against shrinking, the compositor never sees a truncated
+  // pool under a buffer it's reading
+  XDWL_SHM_SEAL = 1 << 2,
+};
+
+struct xdwl_shm_stats {
+  size_t hugetlb_bytes;    // backed by hugetlbfs pages
+  size_t populated_bytes;  // faulted in up front
+  long populate_faults;    // minor faults taken while populating
+  uint64_t faults_avoided; // first touch faults buffers won't take anymore
+};
+
+struct xdwl_shm_buffer {
+  struct xdwl_link link;
+  struct xdwl_shm_allocator *allocator;
+  xdwl_id id;
+  size_t offset;
+  size_t size;
+  int32_t width;
+  int32_t height;
+  int32_t stride;
+  uint32_t format;
+  void *data; // changes when the pool grows, don't cache it across creates
+};
+
+struct xdwl_shm_allocator {
+  xdwl_proxy *proxy;
+  xdwl_id shm_id;
+  xdwl_id pool_id;
+  uint32_t flags;
+  int hugetlb;      // XDWL_SHM_HUGEPAGE got real huge pages, not just advice
+  size_t page_size; // the pool grows by multiples of it
+  int fd;
+  char *data;
+  size_t size;
+  xdwl_ilist free_blocks; // sorted by offset, neighbours always coalesced
+  xdwl_ilist buffers;
+  xdwl_pool *block_pool;
+  xdwl_pool *buffer_pool;
+  struct xdwl_shm_stats stats;
+};
+
+XDWL_MUST_CHECK struct xdwl_shm_allocator *
+xdwl_shm_allocator_create(xdwl_proxy *proxy, xdwl_id wl_shm_id, size_t size,
+                          uint32_t flags);
+void xdwl_shm_allocator_destroy(struct xdwl_shm_allocator *allocator);
+void xdwl_shm_allocator_get_stats(struct xdwl_shm_allocator *allocator,
+                                  struct xdwl_shm_stats *stats);
+
+XDWL_MUST_CHECK struct xdwl_shm_buffer *
+xdwl_shm_buffer_create(struct xdwl_shm_allocator *allocator, int32_t width,
+                       int32_t height, int32_t stride, uint32_t format);
+void xdwl_shm_buffer_destroy(struct xdwl_shm_buffer *buffer);
+
+#endif
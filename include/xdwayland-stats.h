@@ -0,0 +1,44 @@
+#ifndef XDWAYLAND_STATS_H
+#define XDWAYLAND_STATS_H
+
+#include "xdwayland-types.h"
+
+// opcodes at or past this share the last slot
+#define XDWL_STATS_MAX_OPCODES 32
+
+struct xdwl_opcode_stats {
+  uint64_t messages;
+  uint64_t bytes; // header included
+  uint64_t fds;
+  uint64_t handler_ns; // events only, see xdwl_proxy_time_handlers
+};
+
+struct xdwl_interface_stats {
+  struct xdwl_interface_stats *next;
+  const struct xdwl_interface *interface;
+  struct xdwl_opcode_stats requests[XDWL_STATS_MAX_OPCODES];
+  struct xdwl_opcode_stats events[XDWL_STATS_MAX_OPCODES];
+};
+
+// a copy, counters keep moving on the proxy while it's being taken so they
+// only agree with each other approximately
+struct xdwl_stats {
+  struct xdwl_io_stats io;
+  struct xdwl_alloc_stats memory[XDWL_ALLOC_SUBSYSTEMS]; // by subsystem
+  size_t interface_count;
+  struct xdwl_interface_stats *interfaces; // next is meaningless here
+};
+
+// counters are always on and updated with relaxed atomics, both of these
+// can run on another thread than the one dispatching
+XDWL_MUST_CHECK int xdwl_proxy_get_stats(xdwl_proxy *proxy,
+                                         struct xdwl_stats *stats);
+void xdwl_proxy_reset_stats(xdwl_proxy *proxy);
+
+// off by default, two clock reads around every handler cost more than all
+// the counters together
+void xdwl_proxy_time_handlers(xdwl_proxy *proxy, int enable);
+
+void xdwl_stats_release(struct xdwl_stats *stats);
+
+#endif
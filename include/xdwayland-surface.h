@@ -0,0 +1,66 @@
+#ifndef XDWAYLAND_SURFACE_H
+#define XDWAYLAND_SURFACE_H
+
+#include "xdwayland-damage.h"
+#include "xdwayland-types.h"
+
+enum xdwl_surface_field {
+  XDWL_SURFACE_BUFFER = 1 << 0,
+  XDWL_SURFACE_OFFSET = 1 << 1,
+  XDWL_SURFACE_SCALE = 1 << 2,
+  XDWL_SURFACE_TRANSFORM = 1 << 3,
+  XDWL_SURFACE_OPAQUE_REGION = 1 << 4,
+  XDWL_SURFACE_INPUT_REGION = 1 << 5,
+};
+
+struct xdwl_surface_values {
+  xdwl_id buffer; // 0 detaches
+  int32_t offset_x;
+  int32_t offset_y;
+  int32_t scale;
+  int32_t transform;
+  xdwl_id opaque_region; // 0 is the protocol's NULL region
+  xdwl_id input_region;
+  // registration seq of the regions, a recycled id is a different region
+  uint32_t opaque_region_seq;
+  uint32_t input_region_seq;
+};
+
+// setters only record, commit sends what differs from the last commit and
+// then a single wl_surface.commit. regions compare by object, so a region
+// must not be changed in place while a surface state still refers to it
+struct xdwl_surface_state {
+  xdwl_proxy *proxy;
+  xdwl_id surface_id;
+  uint32_t pending_fields; // enum xdwl_surface_field
+  struct xdwl_surface_values pending;
+  struct xdwl_surface_values current;
+  struct xdwl_damage damage; // buffer coordinates
+  uint64_t requests_sent;
+  uint64_t requests_elided;
+};
+
+void xdwl_surface_state_init(struct xdwl_surface_state *state,
+                             xdwl_proxy *proxy, xdwl_id wl_surface_id);
+
+// the buffer is attached on every commit it was set for, even if it's the
+// one already attached, that's how new contents get shown
+void xdwl_surface_state_attach(struct xdwl_surface_state *state,
+                               xdwl_id wl_buffer_id);
+// wl_surface.offset, needs version 5. sent only when nonzero
+void xdwl_surface_state_set_offset(struct xdwl_surface_state *state,
+                                   int32_t x, int32_t y);
+void xdwl_surface_state_set_scale(struct xdwl_surface_state *state,
+                                  int32_t scale);
+void xdwl_surface_state_set_transform(struct xdwl_surface_state *state,
+                                      int32_t transform);
+void xdwl_surface_state_set_opaque_region(struct xdwl_surface_state *state,
+                                          xdwl_id wl_region_id);
+void xdwl_surface_state_set_input_region(struct xdwl_surface_state *state,
+                                         xdwl_id wl_region_id);
+void xdwl_surface_state_damage(struct xdwl_surface_state *state, int32_t x,
+                               int32_t y, int32_t width, int32_t height);
+
+XDWL_MUST_CHECK int xdwl_surface_state_commit(struct xdwl_surface_state *state);
+
+#endif
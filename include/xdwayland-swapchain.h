@@ -0,0 +1,54 @@
+#ifndef XDWAYLAND_SWAPCHAIN_H
+#define XDWAYLAND_SWAPCHAIN_H
+
+#include "xdwayland-damage.h"
+#include "xdwayland-shm.h"
+#include "xdwayland-types.h"
+
+#define XDWL_SWAPCHAIN_MAX_BUFFERS 4
+// frames of damage remembered, buffers older than that are repainted whole
+#define XDWL_SWAPCHAIN_HISTORY 8
+
+struct xdwl_swapchain_buffer {
+  struct xdwl_swapchain *swapchain;
+  struct xdwl_shm_buffer *shm;
+  uint8_t busy;       // submitted and not released by the compositor yet
+  uint64_t last_used; // frame number of the last submit, 0 if never shown
+  uint32_t age;       // set on acquire, 0 means the contents are undefined
+  // set on acquire, everything that changed since the buffer was last shown
+  struct xdwl_damage damage;
+};
+
+struct xdwl_swapchain {
+  struct xdwl_shm_allocator *allocator;
+  int32_t width;
+  int32_t height;
+  uint32_t format;
+  size_t buffer_count;
+  uint64_t frame;
+  struct xdwl_swapchain_buffer buffers[XDWL_SWAPCHAIN_MAX_BUFFERS];
+  struct xdwl_damage history[XDWL_SWAPCHAIN_HISTORY]; // by frame number
+};
+
+XDWL_MUST_CHECK struct xdwl_swapchain *
+xdwl_swapchain_create(struct xdwl_shm_allocator *allocator,
+                      size_t buffer_count, int32_t width, int32_t height,
+                      uint32_t format);
+void xdwl_swapchain_destroy(struct xdwl_swapchain *swapchain);
+void xdwl_swapchain_resize(struct xdwl_swapchain *swapchain, int32_t width,
+                           int32_t height);
+
+XDWL_MUST_CHECK struct xdwl_swapchain_buffer *
+xdwl_swapchain_acquire(struct xdwl_swapchain *swapchain);
+// damage is what changed in this frame, NULL if everything did
+void xdwl_swapchain_submit(struct xdwl_swapchain *swapchain,
+                           struct xdwl_swapchain_buffer *buffer,
+                           const struct xdwl_damage *damage);
+
+// copies buffer's stale damage from the newest buffer, after which only the
+// new frame's own damage needs painting. does nothing without a newest buffer
+// of the same size, the damage then stays for the caller to repaint
+void xdwl_swapchain_copy_forward(struct xdwl_swapchain *swapchain,
+                                 struct xdwl_swapchain_buffer *buffer);
+
+#endif
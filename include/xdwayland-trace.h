@@ -0,0 +1,29 @@
+#ifndef XDWAYLAND_TRACE_H
+#define XDWAYLAND_TRACE_H
+
+#include "xdwayland-types.h"
+
+// interfaces a filter can name at once
+#define XDWL_TRACE_MAX_FILTERS 32
+
+// every request and event with its arguments, for all proxies in the
+// process. messages are formatted into an in-memory ring and written out
+// by a background thread, a full ring drops messages instead of blocking.
+// XDWL_DEBUG=1 turns it on at startup, XDWL_DEBUG=wl_surface,wl_pointer
+// also sets the filter
+void xdwl_trace_enable(int enable);
+
+// comma separated interface names, NULL or "" traces everything. call it
+// from the thread the proxies are used on, it interns the names
+XDWL_MUST_CHECK int xdwl_trace_set_filter(const char *interfaces);
+
+// stderr by default, the fd stays open after tracing is turned off
+void xdwl_trace_set_output(int fd);
+
+// blocks until everything traced so far is written
+void xdwl_trace_flush();
+
+// messages lost to a full ring since startup
+uint64_t xdwl_trace_get_dropped();
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef XDWAYLAND_TYPES_H
 #define XDWAYLAND_TYPES_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -12,18 +13,75 @@
 
 typedef unsigned int xdwl_id;
 
+// where a proxy's memory comes from, see xdwl_proxy_create_with_allocator.
+// free gets the size that was asked for, so arenas don't need headers
+struct xdwl_allocator {
+  void *(*alloc)(void *data, size_t size);
+  void (*free)(void *data, void *ptr, size_t size);
+  void *data;
+};
+
+enum xdwl_alloc_subsystem {
+  XDWL_ALLOC_REGISTRY,  // objects and the id to object map
+  XDWL_ALLOC_LISTENERS, // the listener map and handler tables
+  XDWL_ALLOC_BITMAPS,   // client and server id pools
+  XDWL_ALLOC_BUFFERS,   // the input and output buffers
+  XDWL_ALLOC_STATS,     // per-interface counters
+  XDWL_ALLOC_OTHER,     // the proxy itself
+  XDWL_ALLOC_SUBSYSTEMS,
+};
+
+struct xdwl_alloc_stats {
+  uint64_t live_bytes;
+  uint64_t allocations;
+  uint64_t frees;
+};
+
+// what a collection allocates from and is counted as. collections created
+// without one use libc and aren't counted
+struct xdwl_alloc_account {
+  const struct xdwl_allocator *allocator;
+  struct xdwl_alloc_stats stats;
+};
+
+// slots are laid out inline: the value follows the header in the same slot
 struct xdwl_map_pair {
   size_t key;
-  void *value;
-  struct xdwl_map_pair *next;
-  struct xdwl_map_pair *prev;
+  size_t distance; // probe distance + 1, 0 marks an empty slot
+  unsigned char value[];
 };
 
 typedef struct xdwl_map {
-  struct xdwl_map_pair **pairs;
+  char *slots;
   size_t size;
+  size_t count;
+  size_t stride;
+  size_t value_size;
+  unsigned int shift;
+  float max_load;
+
+  // table being migrated into slots, a few entries per set/remove
+  char *old_slots;
+  size_t old_size;
+  size_t old_count;
+  size_t old_index;
+  unsigned int old_shift;
+
+  struct xdwl_alloc_account *account;
 } xdwl_map;
 
+struct xdwl_pool_slab {
+  struct xdwl_pool_slab *next;
+};
+
+typedef struct xdwl_pool {
+  struct xdwl_pool_slab *slabs;
+  void *free_items;
+  size_t item_size;
+  size_t items_per_slab;
+  struct xdwl_alloc_account *account;
+} xdwl_pool;
+
 typedef union xdwl_arg {
   xdwl_id object_id;
   int32_t i;
@@ -33,43 +91,114 @@ typedef union xdwl_arg {
   int fd;
 } xdwl_arg;
 
+// the most a single recvmsg can carry, same as libwayland
+#define XDWL_PROXY_MAX_FDS 28
+
+// socket calls, whatever they carried. bytes over calls is how well
+// messages get batched
+struct xdwl_io_stats {
+  uint64_t send_calls;
+  uint64_t bytes_sent;
+  uint64_t recv_calls;
+  uint64_t bytes_received;
+};
+
 typedef struct xdwl_proxy {
   int sockfd;
   xdwl_map *object_registry;
+  xdwl_pool *object_pool;
   struct xdwl_bitmap *client_id_pool;
   struct xdwl_bitmap *server_id_pool;
   xdwl_map *event_listeners;
   uint32_t seq;
+
+  // received and not dispatched yet, a message split across two reads
+  // waits here for the rest of it
+  char *in_buffer;
+  size_t in_start;
+  size_t in_end;
+  int in_fds[XDWL_PROXY_MAX_FDS];
+  size_t in_fd_count;
+
+  // see xdwayland-stats.h, every interface an object was registered with
+  // has an entry. the list is only ever prepended to so other threads can
+  // walk it
+  xdwl_map *stats_by_interface;
+  struct xdwl_interface_stats *stats;
+  struct xdwl_io_stats io;
+  uint8_t time_handlers;
+
+  struct xdwl_capture *capture; // NULL unless capturing
+
+  // requests written while corked, sent by xdwl_proxy_flush
+  char *out_buffer;
+  size_t out_length;
+  uint8_t corked;
+
+  // everything the proxy owns is allocated through one of the accounts,
+  // which all point at allocator
+  struct xdwl_allocator allocator;
+  struct xdwl_alloc_account accounts[XDWL_ALLOC_SUBSYSTEMS];
 } xdwl_proxy;
 
 typedef struct xdwl_object {
   xdwl_id id;
-  char *name;
+  const char *name;
   const struct xdwl_interface *interface;
+  struct xdwl_interface_stats *stats; // shared by all of the interface
   uint32_t seq;
 } xdwl_object;
 
 typedef struct xdwl_bitmap {
   uint8_t *bytes;
   size_t size;
+  struct xdwl_alloc_account *account;
 } xdwl_bitmap;
 
+struct xdwl_link {
+  struct xdwl_link *prev;
+  struct xdwl_link *next;
+};
+
+// head.prev and tail.next are always NULL, every real link has neighbours
+typedef struct xdwl_ilist {
+  struct xdwl_link head;
+  struct xdwl_link tail;
+  size_t length;
+} xdwl_ilist;
+
+struct xdwl_list_node {
+  struct xdwl_link link;
+  unsigned char data[];
+};
+
 typedef struct xdwl_list {
-  void *data;
-  struct xdwl_list *prev;
-  struct xdwl_list *next;
+  xdwl_ilist items;
 } xdwl_list;
 
+struct xdwl_rect {
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+};
+
 struct xdwl_method {
   char *name;
   size_t arg_count;
   char *signature;
+  // the interface of the object the new_id argument at new_id_index
+  // creates, NULL if there is none or it's untyped like wl_registry.bind's
+  const char *new_interface;
+  size_t new_id_index;
 };
 
 struct xdwl_interface {
   char *name;
   const struct xdwl_method *requests;
   const struct xdwl_method *events;
+  size_t request_count;
+  size_t event_count;
 };
 
 enum xdwl_errors {
@@ -88,6 +217,7 @@ enum xdwl_errors {
   XDWLERR_NOFREEBIT,
   XDWLERR_OUTOFRANGE,
   XDWLERR_NOPROTOXML,
+  XDWLERR_NOBUFFER,
 };
 
 typedef void(xdwl_event_handler)(void *, xdwl_arg *);
@@ -0,0 +1,724 @@
+#include "xdwayland-mock.h"
+#include "xdwayland-client.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-private.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 8
+#define MAX_ARGS 16
+#define IN_BUFFER_SIZE (1 << 16)
+#define OUT_BUFFER_SIZE (1 << 16)
+#define MAP_SIZE_HINT 64
+
+#define DISPLAY_ID 1
+#define DISPLAY_DELETE_ID 1
+#define CALLBACK_DONE 0
+#define REGISTRY_GLOBAL 0
+#define BUFFER_RELEASE 0
+
+struct mock_object {
+  const struct xdwl_interface *interface;
+  uint32_t seq;
+  xdwl_id pending_buffer; // wl_surface only
+  xdwl_id current_buffer;
+  uint8_t attached;
+};
+
+struct mock_global {
+  uint32_t name;
+  const char *interface; // interned
+  uint32_t version;
+};
+
+struct mock_frame {
+  xdwl_id surface;
+  xdwl_id callback;
+};
+
+// requests that create an object, and the argument holding its id
+struct mock_creator {
+  const char *interface;
+  const char *request;
+  const char *creates;
+  size_t arg;
+};
+
+static const struct mock_creator mock_creators[] = {
+    {"wl_display", "sync", "wl_callback", 1},
+    {"wl_display", "get_registry", "wl_registry", 1},
+    {"wl_compositor", "create_surface", "wl_surface", 1},
+    {"wl_compositor", "create_region", "wl_region", 1},
+    {"wl_shm", "create_pool", "wl_shm_pool", 1},
+    {"wl_shm_pool", "create_buffer", "wl_buffer", 1},
+    {"wl_surface", "frame", "wl_callback", 1},
+    {"wl_seat", "get_pointer", "wl_pointer", 1},
+    {"wl_seat", "get_keyboard", "wl_keyboard", 1},
+    {"wl_seat", "get_touch", "wl_touch", 1},
+    {"wl_shell", "get_shell_surface", "wl_shell_surface", 1},
+    {"wl_subcompositor", "get_subsurface", "wl_subsurface", 1},
+    {"wl_data_device_manager", "create_data_source", "wl_data_source", 1},
+    {"wl_data_device_manager", "get_data_device", "wl_data_device", 1},
+};
+
+struct xdwl_mock {
+  int fd;
+  int client_fd;
+  pthread_t thread;
+
+  // recursive, hooks run with it held and may send events themselves
+  pthread_mutex_t lock;
+
+  xdwl_map *objects; // id to struct mock_object
+  uint32_t seq;
+  uint32_t serial;
+
+  struct mock_global globals[XDWL_MOCK_MAX_GLOBALS];
+  size_t global_count;
+  xdwl_id registries[XDWL_MOCK_MAX_GLOBALS];
+  size_t registry_count;
+
+  struct mock_frame *frames;
+  size_t frame_count;
+  size_t frame_capacity;
+
+  xdwl_mock_request_hook *hook;
+  void *hook_data;
+
+  char *in_buffer;
+  size_t in_start;
+  size_t in_end;
+  int in_fds[XDWL_PROXY_MAX_FDS];
+  size_t in_fd_count;
+
+  char *out_buffer;
+  size_t out_length;
+  int out_fd;
+};
+
+static const struct xdwl_interface *mock_interface(const char *name) {
+  return xdwl_interface_lookup(xdwl_intern_lookup(name));
+}
+
+static uint32_t mock_time_ms() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int mock_write(struct xdwl_mock *mock) {
+  size_t written = 0;
+
+  while (written < mock->out_length) {
+    ssize_t n;
+
+    if (mock->out_fd >= 0) {
+      char cmsg[CMSG_SPACE(sizeof(int))];
+      struct iovec e = {mock->out_buffer + written,
+                        mock->out_length - written};
+      struct msghdr m = {NULL, 0, &e, 1, cmsg, sizeof(cmsg), 0};
+      struct cmsghdr *c = CMSG_FIRSTHDR(&m);
+
+      c->cmsg_level = SOL_SOCKET;
+      c->cmsg_type = SCM_RIGHTS;
+      c->cmsg_len = CMSG_LEN(sizeof(int));
+      *(int *)CMSG_DATA(c) = mock->out_fd;
+
+      n = sendmsg(mock->fd, &m, MSG_NOSIGNAL);
+      if (n > 0)
+        mock->out_fd = -1;
+    } else {
+      n = send(mock->fd, mock->out_buffer + written,
+               mock->out_length - written, MSG_NOSIGNAL);
+    }
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      perror("send");
+      xdwl_error_set(XDWLERR_SOCKSEND, "xdwl_mock_flush: failed to send");
+      mock->out_length = 0;
+      return -1;
+    }
+
+    written += n;
+  }
+
+  mock->out_length = 0;
+  return 0;
+}
+
+static int mock_queue(struct xdwl_mock *mock, xdwl_id object_id,
+                      xdwl_id opcode, xdwl_arg *args) {
+  struct mock_object *object = xdwl_map_get(mock->objects, object_id);
+  if (!object) {
+    xdwl_error_set(XDWLERR_NULLOBJ,
+                   "xdwl_mock_queue_event: no object with id %d", object_id);
+    return -1;
+  }
+
+  char *signature = object->interface->events[opcode].signature;
+  size_t arg_count = signature ? strlen(signature) : 0;
+  size_t size =
+      HEADER_SIZE + xdwl_calculate_body_size(args, arg_count, signature);
+  int fd = -1;
+
+  for (size_t i = 0; i < arg_count; i++) {
+    if (signature[i] == 'h')
+      fd = args[i].fd;
+  }
+
+  // one fd per write keeps it attached to the bytes of its own message
+  if (mock->out_length + size > OUT_BUFFER_SIZE ||
+      (fd >= 0 && mock->out_fd >= 0)) {
+    if (mock_write(mock) == -1)
+      return -1;
+  }
+
+  // offsets start from the message, xdwl_write_args stops at 4096 bytes
+  char *message = mock->out_buffer + mock->out_length;
+  size_t offset = 0;
+  xdwl_buf_write_u32(message, &offset, object_id);
+  xdwl_buf_write_u16(message, &offset, opcode);
+  xdwl_buf_write_u16(message, &offset, size);
+  xdwl_write_args(message, &offset, args, arg_count, signature);
+
+  mock->out_length += size;
+  if (fd >= 0)
+    mock->out_fd = fd;
+
+  return 0;
+}
+
+static int mock_queue_va(struct xdwl_mock *mock, xdwl_id object_id,
+                         xdwl_id opcode, va_list ap) {
+  struct mock_object *object = xdwl_map_get(mock->objects, object_id);
+  if (!object) {
+    xdwl_error_set(XDWLERR_NULLOBJ,
+                   "xdwl_mock_queue_event: no object with id %d", object_id);
+    return -1;
+  }
+
+  char *signature = object->interface->events[opcode].signature;
+  size_t arg_count = signature ? strlen(signature) : 0;
+  xdwl_arg args[MAX_ARGS];
+
+  for (size_t i = 0; i < arg_count && i < MAX_ARGS; i++) {
+    switch (signature[i]) {
+    case 'i':
+      args[i].i = va_arg(ap, int32_t);
+      break;
+
+    case 'u':
+      args[i].u = va_arg(ap, uint32_t);
+      break;
+
+    case 'f':
+      args[i].f = va_arg(ap, double);
+      break;
+
+    case 's':
+      args[i].s = va_arg(ap, char *);
+      break;
+
+    case 'h':
+      args[i].fd = va_arg(ap, int32_t);
+      break;
+    }
+  }
+
+  return mock_queue(mock, object_id, opcode, args);
+}
+
+static int mock_object_add(struct xdwl_mock *mock, xdwl_id id,
+                           const struct xdwl_interface *interface) {
+  struct mock_object object = {
+      .interface = interface,
+      .seq = mock->seq++,
+  };
+
+  if (!interface) {
+    xdwl_error_set(XDWLERR_NULLIFACE,
+                   "xdwl_mock: object %d has an unknown interface", id);
+    return -1;
+  }
+
+  if (xdwl_map_set(mock->objects, id, &object, sizeof(object)) == NULL)
+    return -1;
+
+  return 0;
+}
+
+// the id is free for the client to reuse once delete_id arrives
+static int mock_object_remove(struct xdwl_mock *mock, xdwl_id id) {
+  xdwl_arg arg = {.u = id};
+
+  if (mock_queue(mock, DISPLAY_ID, DISPLAY_DELETE_ID, &arg) == -1)
+    return -1;
+
+  xdwl_map_remove(mock->objects, id);
+  return 0;
+}
+
+static int mock_callback_done(struct xdwl_mock *mock, xdwl_id callback,
+                              uint32_t data) {
+  xdwl_arg arg = {.u = data};
+
+  if (mock_queue(mock, callback, CALLBACK_DONE, &arg) == -1)
+    return -1;
+
+  return mock_object_remove(mock, callback);
+}
+
+static int mock_announce(struct xdwl_mock *mock, xdwl_id registry,
+                         struct mock_global *global) {
+  xdwl_arg args[3] = {
+      {.u = global->name},
+      {.s = (char *)global->interface},
+      {.u = global->version},
+  };
+
+  return mock_queue(mock, registry, REGISTRY_GLOBAL, args);
+}
+
+static int mock_commit(struct xdwl_mock *mock, xdwl_id surface_id) {
+  struct mock_object *surface = xdwl_map_get(mock->objects, surface_id);
+
+  if (surface->attached) {
+    xdwl_id previous = surface->current_buffer;
+
+    surface->current_buffer = surface->pending_buffer;
+    surface->attached = 0;
+
+    // shm contents are as good as copied, the old buffer is free again
+    if (previous && previous != surface->current_buffer &&
+        xdwl_map_get(mock->objects, previous) &&
+        mock_queue(mock, previous, BUFFER_RELEASE, NULL) == -1)
+      return -1;
+  }
+
+  uint32_t time = mock_time_ms();
+  size_t kept = 0;
+
+  for (size_t i = 0; i < mock->frame_count; i++) {
+    struct mock_frame frame = mock->frames[i];
+
+    if (frame.surface != surface_id) {
+      mock->frames[kept++] = frame;
+      continue;
+    }
+
+    if (mock_callback_done(mock, frame.callback, time) == -1)
+      return -1;
+  }
+
+  mock->frame_count = kept;
+  return 0;
+}
+
+static int mock_frame_add(struct xdwl_mock *mock, xdwl_id surface,
+                          xdwl_id callback) {
+  if (mock->frame_count == mock->frame_capacity) {
+    size_t capacity = mock->frame_capacity ? mock->frame_capacity * 2 : 8;
+    struct mock_frame *frames =
+        realloc(mock->frames, capacity * sizeof(struct mock_frame));
+    if (!frames) {
+      perror("realloc");
+      xdwl_error_set(XDWLERR_STD, "xdwl_mock: failed to realloc()");
+      return -1;
+    }
+
+    mock->frames = frames;
+    mock->frame_capacity = capacity;
+  }
+
+  mock->frames[mock->frame_count].surface = surface;
+  mock->frames[mock->frame_count].callback = callback;
+  mock->frame_count++;
+  return 0;
+}
+
+static int mock_handle_request(struct xdwl_mock *mock, xdwl_id object_id,
+                               const struct xdwl_interface *interface,
+                               xdwl_id opcode, xdwl_arg *args) {
+  const char *request = interface->requests[opcode].name;
+
+  for (size_t i = 0; i < sizeof(mock_creators) / sizeof(mock_creators[0]);
+       i++) {
+    const struct mock_creator *c = &mock_creators[i];
+
+    if (strcmp(c->interface, interface->name) != 0 ||
+        strcmp(c->request, request) != 0)
+      continue;
+
+    xdwl_id id = args[c->arg].u;
+    if (mock_object_add(mock, id, mock_interface(c->creates)) == -1)
+      return -1;
+
+    if (strcmp(request, "sync") == 0)
+      return mock_callback_done(mock, id, mock->serial++);
+
+    if (strcmp(request, "frame") == 0)
+      return mock_frame_add(mock, object_id, id);
+
+    if (strcmp(request, "get_registry") == 0) {
+      if (mock->registry_count < XDWL_MOCK_MAX_GLOBALS)
+        mock->registries[mock->registry_count++] = id;
+
+      for (size_t g = 0; g < mock->global_count; g++) {
+        if (mock_announce(mock, id, &mock->globals[g]) == -1)
+          return -1;
+      }
+    }
+
+    return 0;
+  }
+
+  if (strcmp(interface->name, "wl_registry") == 0 &&
+      strcmp(request, "bind") == 0)
+    return mock_object_add(mock, args[4].u, mock_interface(args[2].s));
+
+  if (strcmp(interface->name, "wl_surface") == 0) {
+    struct mock_object *surface = xdwl_map_get(mock->objects, object_id);
+
+    if (strcmp(request, "attach") == 0) {
+      surface->pending_buffer = args[1].u;
+      surface->attached = 1;
+      return 0;
+    }
+
+    if (strcmp(request, "commit") == 0)
+      return mock_commit(mock, object_id);
+  }
+
+  if (strcmp(request, "destroy") == 0 || strcmp(request, "release") == 0)
+    return mock_object_remove(mock, object_id);
+
+  return 0;
+}
+
+static int mock_next_request(struct xdwl_mock *mock) {
+  size_t available = mock->in_end - mock->in_start;
+  size_t offset = mock->in_start;
+
+  if (available < HEADER_SIZE)
+    return 0;
+
+  xdwl_id object_id = xdwl_buf_read_u32(mock->in_buffer, &offset);
+  uint16_t opcode = xdwl_buf_read_u16(mock->in_buffer, &offset);
+  uint16_t size = xdwl_buf_read_u16(mock->in_buffer, &offset);
+
+  if (size < HEADER_SIZE) {
+    xdwl_error_set(XDWLERR_SOCKRECV, "xdwl_mock: malformed request");
+    return -1;
+  }
+
+  if (size > available)
+    return 0;
+
+  mock->in_start += size;
+
+  struct mock_object *object = xdwl_map_get(mock->objects, object_id);
+  if (!object) {
+    xdwl_error_set(XDWLERR_NULLOBJ,
+                   "xdwl_mock: request for unknown object %d", object_id);
+    return -1;
+  }
+
+  const struct xdwl_interface *interface = object->interface;
+  if (opcode >= interface->request_count) {
+    xdwl_error_set(XDWLERR_NULLEVENT, "xdwl_mock: %s has no request %d",
+                   interface->name, opcode);
+    return -1;
+  }
+
+  char *signature = interface->requests[opcode].signature;
+  struct xdwl_raw_message message = {
+      .object_id = object_id,
+      .method_id = opcode,
+      .body_length = size - HEADER_SIZE,
+      .body = mock->in_buffer + offset,
+      .fd = -1,
+  };
+  xdwl_arg args[MAX_ARGS + 1];
+
+  args[0].object_id = object_id;
+
+  if (signature) {
+    if (strchr(signature, 'h') && mock->in_fd_count > 0) {
+      message.fd = mock->in_fds[0];
+      mock->in_fd_count--;
+      memmove(mock->in_fds, mock->in_fds + 1,
+              mock->in_fd_count * sizeof(int));
+    }
+
+    xdwl_read_args(&message, args, signature);
+  }
+
+  int r = 1;
+  if ((!mock->hook || !mock->hook(mock->hook_data, mock, object_id, interface,
+                                  opcode, args)) &&
+      mock_handle_request(mock, object_id, interface, opcode, args) == -1)
+    r = -1;
+
+  // nothing here maps a pool, the fd is done with either way
+  if (message.fd >= 0)
+    close(message.fd);
+
+  return r;
+}
+
+static ssize_t mock_recv(struct xdwl_mock *mock) {
+  char cmsg[CMSG_SPACE(sizeof(int) * XDWL_PROXY_MAX_FDS)];
+
+  if (mock->in_start > 0) {
+    memmove(mock->in_buffer, mock->in_buffer + mock->in_start,
+            mock->in_end - mock->in_start);
+    mock->in_end -= mock->in_start;
+    mock->in_start = 0;
+  }
+
+  struct iovec e = {mock->in_buffer + mock->in_end,
+                    IN_BUFFER_SIZE - mock->in_end};
+  struct msghdr m = {NULL, 0, &e, 1, cmsg, sizeof(cmsg), 0};
+
+  ssize_t n = recvmsg(mock->fd, &m, MSG_CMSG_CLOEXEC);
+  if (n <= 0)
+    return n;
+
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&m); c != NULL;
+       c = CMSG_NXTHDR(&m, c)) {
+    size_t fd_count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int *fds = (int *)CMSG_DATA(c);
+
+    for (size_t i = 0; i < fd_count; i++) {
+      if (mock->in_fd_count < XDWL_PROXY_MAX_FDS)
+        mock->in_fds[mock->in_fd_count++] = fds[i];
+      else
+        close(fds[i]);
+    }
+  }
+
+  mock->in_end += n;
+  return n;
+}
+
+static void *mock_main(void *data) {
+  struct xdwl_mock *mock = data;
+
+  for (;;) {
+    ssize_t n = mock_recv(mock);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return NULL;
+
+    pthread_mutex_lock(&mock->lock);
+
+    int r;
+    while ((r = mock_next_request(mock)) > 0)
+      ;
+
+    if (r == -1 || mock_write(mock) == -1)
+      xdwl_error_print();
+
+    pthread_mutex_unlock(&mock->lock);
+  }
+}
+
+struct xdwl_mock *xdwl_mock_create() {
+  int fds[2];
+  pthread_mutexattr_t attr;
+
+  struct xdwl_mock *mock = calloc(1, sizeof(struct xdwl_mock));
+  if (!mock) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_mock_create: failed to calloc()");
+    return NULL;
+  }
+
+  mock->out_fd = -1;
+  mock->in_buffer = malloc(IN_BUFFER_SIZE);
+  mock->out_buffer = malloc(OUT_BUFFER_SIZE);
+  mock->objects = xdwl_map_new(MAP_SIZE_HINT);
+  if (!mock->in_buffer || !mock->out_buffer || !mock->objects) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_mock_create: failed to malloc()");
+    goto err_alloc;
+  }
+
+  if (mock_object_add(mock, DISPLAY_ID, mock_interface("wl_display")) == -1)
+    goto err_alloc;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+    perror("socketpair");
+    xdwl_error_set(XDWLERR_SOCKCONN, "xdwl_mock_create: failed to socketpair()");
+    goto err_alloc;
+  }
+
+  mock->fd = fds[0];
+  mock->client_fd = fds[1];
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&mock->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  if (pthread_create(&mock->thread, NULL, mock_main, mock) != 0) {
+    perror("pthread_create");
+    xdwl_error_set(XDWLERR_STD, "xdwl_mock_create: failed to pthread_create()");
+    pthread_mutex_destroy(&mock->lock);
+    close(fds[0]);
+    close(fds[1]);
+    goto err_alloc;
+  }
+
+  return mock;
+
+err_alloc:
+  xdwl_map_destroy(mock->objects);
+  free(mock->in_buffer);
+  free(mock->out_buffer);
+  free(mock);
+  return NULL;
+}
+
+void xdwl_mock_destroy(struct xdwl_mock *mock) {
+  if (!mock)
+    return;
+
+  // wakes the thread up with an end of file
+  shutdown(mock->fd, SHUT_RDWR);
+  pthread_join(mock->thread, NULL);
+  close(mock->fd);
+
+  for (size_t i = 0; i < mock->in_fd_count; i++)
+    close(mock->in_fds[i]);
+
+  pthread_mutex_destroy(&mock->lock);
+  xdwl_map_destroy(mock->objects);
+  free(mock->frames);
+  free(mock->in_buffer);
+  free(mock->out_buffer);
+  free(mock);
+}
+
+int xdwl_mock_get_client_fd(struct xdwl_mock *mock) { return mock->client_fd; }
+
+void xdwl_mock_set_request_hook(struct xdwl_mock *mock,
+                                xdwl_mock_request_hook *hook,
+                                void *user_data) {
+  pthread_mutex_lock(&mock->lock);
+  mock->hook = hook;
+  mock->hook_data = user_data;
+  pthread_mutex_unlock(&mock->lock);
+}
+
+uint32_t xdwl_mock_add_global(struct xdwl_mock *mock, const char *interface,
+                              uint32_t version) {
+  uint32_t name = 0;
+
+  pthread_mutex_lock(&mock->lock);
+
+  if (mock->global_count == XDWL_MOCK_MAX_GLOBALS) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_mock_add_global: no room for more than %d globals",
+                   XDWL_MOCK_MAX_GLOBALS);
+    goto out;
+  }
+
+  const char *interned = xdwl_intern(interface);
+  if (!interned)
+    goto out;
+
+  struct mock_global *global = &mock->globals[mock->global_count];
+  global->name = mock->global_count + 1;
+  global->interface = interned;
+  global->version = version;
+  mock->global_count++;
+
+  for (size_t i = 0; i < mock->registry_count; i++) {
+    if (xdwl_map_get(mock->objects, mock->registries[i]) &&
+        mock_announce(mock, mock->registries[i], global) == -1)
+      goto out;
+  }
+
+  if (mock_write(mock) == -1)
+    goto out;
+
+  name = global->name;
+
+out:
+  pthread_mutex_unlock(&mock->lock);
+  return name;
+}
+
+xdwl_id xdwl_mock_find_object(struct xdwl_mock *mock, const char *interface) {
+  const struct xdwl_interface *wanted = mock_interface(interface);
+  struct xdwl_map_pair *pair;
+  struct mock_object *newest = NULL;
+  xdwl_id id = 0;
+
+  pthread_mutex_lock(&mock->lock);
+
+  xdwl_map_for_each(mock->objects, pair) {
+    struct mock_object *object = (struct mock_object *)pair->value;
+
+    if (object->interface == wanted &&
+        (newest == NULL || newest->seq < object->seq)) {
+      newest = object;
+      id = pair->key;
+    }
+  }
+
+  pthread_mutex_unlock(&mock->lock);
+  return id;
+}
+
+int xdwl_mock_send_event(struct xdwl_mock *mock, xdwl_id object_id,
+                         xdwl_id opcode, ...) {
+  va_list ap;
+  int r;
+
+  va_start(ap, opcode);
+  pthread_mutex_lock(&mock->lock);
+
+  r = mock_queue_va(mock, object_id, opcode, ap);
+  if (r == 0)
+    r = mock_write(mock);
+
+  pthread_mutex_unlock(&mock->lock);
+  va_end(ap);
+  return r;
+}
+
+int xdwl_mock_queue_event(struct xdwl_mock *mock, xdwl_id object_id,
+                          xdwl_id opcode, ...) {
+  va_list ap;
+  int r;
+
+  va_start(ap, opcode);
+  pthread_mutex_lock(&mock->lock);
+  r = mock_queue_va(mock, object_id, opcode, ap);
+  pthread_mutex_unlock(&mock->lock);
+  va_end(ap);
+  return r;
+}
+
+int xdwl_mock_flush(struct xdwl_mock *mock) {
+  int r;
+
+  pthread_mutex_lock(&mock->lock);
+  r = mock_write(mock);
+  pthread_mutex_unlock(&mock->lock);
+  return r;
+}
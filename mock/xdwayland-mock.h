@@ -0,0 +1,53 @@
+#ifndef XDWAYLAND_MOCK_H
+#define XDWAYLAND_MOCK_H
+
+#include "xdwayland-types.h"
+
+#define XDWL_MOCK_MAX_GLOBALS 64
+
+struct xdwl_mock;
+
+// called on the mock's thread for every request, before the built-in
+// handling. args[0] is the object id like for events. returning nonzero
+// skips the built-in handling. an fd argument is closed once this returns,
+// a hook that wants it has to dup it
+typedef int(xdwl_mock_request_hook)(void *, struct xdwl_mock *, xdwl_id,
+                                    const struct xdwl_interface *, xdwl_id,
+                                    xdwl_arg *);
+
+// a compositor on the other end of a socketpair, answering on its own
+// thread. it knows wl_display.sync and get_registry, wl_registry.bind and
+// the core requests that create or destroy objects, fires frame callbacks
+// and releases the previous buffer on wl_surface.commit. anything else only
+// reaches the hook
+XDWL_MUST_CHECK struct xdwl_mock *xdwl_mock_create();
+void xdwl_mock_destroy(struct xdwl_mock *mock);
+
+// the client end, for xdwl_proxy_create_from_fd. the proxy owns it
+int xdwl_mock_get_client_fd(struct xdwl_mock *mock);
+
+void xdwl_mock_set_request_hook(struct xdwl_mock *mock,
+                                xdwl_mock_request_hook *hook, void *user_data);
+
+// announced to every registry, current and future. returns the global name
+XDWL_MUST_CHECK uint32_t xdwl_mock_add_global(struct xdwl_mock *mock,
+                                              const char *interface,
+                                              uint32_t version);
+
+// the newest live object of that interface the client created or bound,
+// 0 if there is none
+xdwl_id xdwl_mock_find_object(struct xdwl_mock *mock, const char *interface);
+
+// arguments follow the event's signature like xdwl_send_request's do. send
+// writes right away, queue only buffers until the next flush or send so a
+// flood goes out in few writes. writes block once the socket is full, a
+// flood bigger than that has to come from another thread than the client's
+XDWL_MUST_CHECK int xdwl_mock_send_event(struct xdwl_mock *mock,
+                                         xdwl_id object_id, xdwl_id opcode,
+                                         ...);
+XDWL_MUST_CHECK int xdwl_mock_queue_event(struct xdwl_mock *mock,
+                                          xdwl_id object_id, xdwl_id opcode,
+                                          ...);
+XDWL_MUST_CHECK int xdwl_mock_flush(struct xdwl_mock *mock);
+
+#endif
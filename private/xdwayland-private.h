@@ -1,6 +1,7 @@
 #ifndef XDWL_PRIVATE_H
 #define XDWL_PRIVATE_H
 
+#include "xdwayland-capture.h"
 #include "xdwayland-types.h"
 #include <stdint.h>
 #include <stdio.h>
@@ -15,11 +16,79 @@ struct xdwl_raw_message {
 
 struct xdwl_listener {
   void *event_handlers;
+  size_t event_handlers_size;
   void *user_data;
 };
 
-void xdwl_log(const char *level, const char *message, ...);
-void xdwl_show_args(xdwl_arg *args, char *signature);
+// plain malloc/free when account is NULL. the counters are relaxed
+// atomics, xdwl_proxy_get_stats reads them from any thread
+extern const struct xdwl_allocator xdwl_libc_allocator;
+XDWL_MUST_CHECK void *xdwl_alloc(struct xdwl_alloc_account *account,
+                                 size_t size);
+XDWL_MUST_CHECK void *xdwl_alloc_zeroed(struct xdwl_alloc_account *account,
+                                        size_t size);
+void xdwl_free(struct xdwl_alloc_account *account, void *ptr, size_t size);
+
+// collections allocating from account, see xdwl_map_new and friends
+xdwl_map *xdwl_map_new_in(size_t size, struct xdwl_alloc_account *account);
+xdwl_pool *xdwl_pool_new_in(size_t item_size, size_t items_per_slab,
+                            struct xdwl_alloc_account *account);
+xdwl_bitmap *xdwl_bitmap_new_in(uint32_t size,
+                                struct xdwl_alloc_account *account);
+
+// xdwl_add_listener for a given object rather than the newest one of a
+// name
+XDWL_MUST_CHECK int xdwl_add_listener_by_id(xdwl_proxy *proxy,
+                                            xdwl_id object_id,
+                                            void *event_handlers,
+                                            size_t event_handlers_size,
+                                            void *user_data);
+
+// interface_name must be interned
+const struct xdwl_interface *xdwl_interface_lookup(const char *interface_name);
+
+// per-proxy counters, see xdwayland-stats.h. the lookup creates the entry
+// for an interface the first time an object uses it
+int xdwl_stats_init(xdwl_proxy *proxy);
+void xdwl_stats_finish(xdwl_proxy *proxy);
+struct xdwl_interface_stats *
+xdwl_stats_lookup(xdwl_proxy *proxy, const struct xdwl_interface *interface);
+
+#define XDWL_STAT_ADD(counter, n)                                              \
+  __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#define XDWL_STAT_OPCODE(opcodes, opcode)                                      \
+  (&(opcodes)[(opcode) < XDWL_STATS_MAX_OPCODES ? (opcode)                     \
+                                                : XDWL_STATS_MAX_OPCODES - 1])
+
+// appends a record, only called while proxy->capture is set
+void xdwl_capture_write(xdwl_proxy *proxy, enum xdwl_capture_direction dir,
+                        const char *data, size_t length, size_t fd_count);
+
+// hands data and fds to the proxy as if a recv had returned them, then
+// dispatches every message that completes. with skipped set, messages for
+// unknown objects or events are counted there instead of failing
+XDWL_MUST_CHECK int xdwl_dispatch_bytes(xdwl_proxy *proxy, const char *data,
+                                        size_t length, const int *fds,
+                                        size_t fd_count, uint64_t *skipped);
+
+// see xdwayland-trace.h. the check is a single load that predicts not
+// taken, the message is only formatted when tracing is on
+extern int xdwl_trace_on;
+#define XDWL_TRACING()                                                         \
+  __builtin_expect(__atomic_load_n(&xdwl_trace_on, __ATOMIC_RELAXED), 0)
+
+// sys/sdt.h probes under the xdwayland provider, built with -Dusdt=true.
+// each is a nop until a tracer attaches, the arguments are only read then
+#ifdef XDWL_USDT
+#include <sys/sdt.h>
+#define XDWL_PROBE(name, ...) STAP_PROBEV(xdwayland, name, ##__VA_ARGS__)
+#else
+#define XDWL_PROBE(name, ...) ((void)0)
+#endif
+
+// args start at the first argument, not the object id
+void xdwl_trace_message(const char *direction, const xdwl_object *object,
+                        const struct xdwl_method *method, xdwl_arg *args);
 
 void xdwl_error_set(enum xdwl_errors errcode, const char *errmsg, ...);
 enum xdwl_errors xdwl_error_get_code();
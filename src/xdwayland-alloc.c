@@ -0,0 +1,50 @@
+#include "xdwayland-client.h"
+#include "xdwayland-private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void *libc_alloc(void *data, size_t size) { return malloc(size); }
+
+static void libc_free(void *data, void *ptr, size_t size) { free(ptr); }
+
+const struct xdwl_allocator xdwl_libc_allocator = {libc_alloc, libc_free,
+                                                    NULL};
+
+void *xdwl_alloc(struct xdwl_alloc_account *account, size_t size) {
+  if (!account)
+    return malloc(size);
+
+  void *ptr = account->allocator->alloc(account->allocator->data, size);
+  if (!ptr)
+    return NULL;
+
+  XDWL_STAT_ADD(account->stats.live_bytes, size);
+  XDWL_STAT_ADD(account->stats.allocations, 1);
+  return ptr;
+}
+
+void *xdwl_alloc_zeroed(struct xdwl_alloc_account *account, size_t size) {
+  if (!account)
+    return calloc(1, size);
+
+  void *ptr = xdwl_alloc(account, size);
+  if (ptr)
+    memset(ptr, 0, size);
+
+  return ptr;
+}
+
+void xdwl_free(struct xdwl_alloc_account *account, void *ptr, size_t size) {
+  if (!ptr)
+    return;
+
+  if (!account) {
+    free(ptr);
+    return;
+  }
+
+  account->allocator->free(account->allocator->data, ptr, size);
+  XDWL_STAT_ADD(account->stats.live_bytes, -size);
+  XDWL_STAT_ADD(account->stats.frees, 1);
+}
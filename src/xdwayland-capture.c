@@ -0,0 +1,252 @@
+#include "xdwayland-capture.h"
+#include "xdwayland-client.h"
+#include "xdwayland-private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+
+struct xdwl_capture {
+  FILE *file;
+  uint64_t start;
+};
+
+static uint64_t capture_now(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int xdwl_capture_start(xdwl_proxy *proxy, const char *path) {
+  xdwl_capture_stop(proxy);
+
+  struct xdwl_capture *capture = malloc(sizeof(struct xdwl_capture));
+  if (!capture) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_capture_start: failed to malloc()");
+    return -1;
+  }
+
+  capture->file = fopen(path, "wbe");
+  if (!capture->file) {
+    perror("fopen");
+    xdwl_error_set(XDWLERR_STD, "xdwl_capture_start: failed to open %s",
+                   path);
+    free(capture);
+    return -1;
+  }
+
+  // stdio batches the writes, a record costs a memcpy most of the time
+  setvbuf(capture->file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+  struct xdwl_capture_header header;
+  memcpy(header.magic, XDWL_CAPTURE_MAGIC, sizeof(header.magic));
+  header.start_ns = capture_now(CLOCK_REALTIME);
+  capture->start = capture_now(CLOCK_MONOTONIC);
+
+  if (fwrite(&header, sizeof(header), 1, capture->file) != 1) {
+    perror("fwrite");
+    xdwl_error_set(XDWLERR_STD, "xdwl_capture_start: failed to write %s",
+                   path);
+    fclose(capture->file);
+    free(capture);
+    return -1;
+  }
+
+  proxy->capture = capture;
+  return 0;
+}
+
+void xdwl_capture_stop(xdwl_proxy *proxy) {
+  if (!proxy->capture)
+    return;
+
+  if (fclose(proxy->capture->file) == EOF)
+    perror("fclose");
+
+  free(proxy->capture);
+  proxy->capture = NULL;
+}
+
+void xdwl_capture_write(xdwl_proxy *proxy, enum xdwl_capture_direction dir,
+                        const char *data, size_t length, size_t fd_count) {
+  struct xdwl_capture *capture = proxy->capture;
+  struct xdwl_capture_record record = {
+      capture_now(CLOCK_MONOTONIC) - capture->start, length, dir, fd_count, 0};
+
+  // a broken capture isn't worth failing the connection over
+  if (fwrite(&record, sizeof(record), 1, capture->file) != 1 ||
+      fwrite(data, 1, length, capture->file) != length) {
+    perror("fwrite");
+    xdwl_capture_stop(proxy);
+  }
+}
+
+int xdwl_capture_read_header(FILE *file, struct xdwl_capture_header *header) {
+  if (fread(header, sizeof(*header), 1, file) != 1 ||
+      memcmp(header->magic, XDWL_CAPTURE_MAGIC, sizeof(header->magic)) != 0)
+    return 0;
+
+  return 1;
+}
+
+int xdwl_capture_read(FILE *file, struct xdwl_capture_record *record,
+                      char *payload) {
+  if (fread(record, sizeof(*record), 1, file) != 1)
+    return 0;
+
+  if (record->length > XDWL_CAPTURE_MAX_RECORD) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_capture_read: record of %u bytes", record->length);
+    return -1;
+  }
+
+  if (fread(payload, 1, record->length, file) != record->length) {
+    xdwl_error_set(XDWLERR_STD, "xdwl_capture_read: truncated record");
+    return -1;
+  }
+
+  return 1;
+}
+
+struct xdwl_replay *xdwl_replay_create(const char *path) {
+  int fds[2];
+
+  struct xdwl_replay *replay = malloc(sizeof(struct xdwl_replay));
+  if (!replay) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_replay_create: failed to malloc()");
+    return NULL;
+  }
+
+  replay->records = 0;
+  replay->bytes = 0;
+  replay->skipped = 0;
+
+  replay->file = fopen(path, "rbe");
+  if (!replay->file) {
+    perror("fopen");
+    xdwl_error_set(XDWLERR_STD, "xdwl_replay_create: failed to open %s", path);
+    free(replay);
+    return NULL;
+  }
+
+  if (!xdwl_capture_read_header(replay->file, &replay->header)) {
+    xdwl_error_set(XDWLERR_STD, "xdwl_replay_create: %s isn't a capture",
+                   path);
+    fclose(replay->file);
+    free(replay);
+    return NULL;
+  }
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+    perror("socketpair");
+    xdwl_error_set(XDWLERR_STD, "xdwl_replay_create: failed to socketpair()");
+    fclose(replay->file);
+    free(replay);
+    return NULL;
+  }
+
+  replay->proxy = xdwl_proxy_create_from_fd(fds[0]);
+  if (!replay->proxy) {
+    close(fds[0]);
+    close(fds[1]);
+    fclose(replay->file);
+    free(replay);
+    return NULL;
+  }
+
+  replay->peer_fd = fds[1];
+  return replay;
+}
+
+void xdwl_replay_destroy(struct xdwl_replay *replay) {
+  if (!replay)
+    return;
+
+  xdwl_proxy_destroy(replay->proxy);
+  close(replay->peer_fd);
+  fclose(replay->file);
+  free(replay);
+}
+
+// throws away what the handlers sent so the socket never fills up
+static void replay_drain(struct xdwl_replay *replay) {
+  char buffer[4096];
+  char cmsg[CMSG_SPACE(sizeof(int) * XDWL_PROXY_MAX_FDS)];
+
+  for (;;) {
+    struct iovec e = {buffer, sizeof(buffer)};
+    struct msghdr m = {NULL, 0, &e, 1, cmsg, sizeof(cmsg), 0};
+
+    if (recvmsg(replay->peer_fd, &m, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) <= 0)
+      return;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&m); c != NULL;
+         c = CMSG_NXTHDR(&m, c)) {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+        continue;
+
+      size_t fd_count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < fd_count; i++)
+        close(((int *)CMSG_DATA(c))[i]);
+    }
+  }
+}
+
+int xdwl_replay_run(struct xdwl_replay *replay, enum xdwl_replay_mode mode) {
+  struct xdwl_capture_record record;
+  int fds[XDWL_PROXY_MAX_FDS];
+  int r;
+
+  char *payload = malloc(XDWL_CAPTURE_MAX_RECORD);
+  if (!payload) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_replay_run: failed to malloc()");
+    return -1;
+  }
+
+  uint64_t start = capture_now(CLOCK_MONOTONIC);
+
+  while ((r = xdwl_capture_read(replay->file, &record, payload)) == 1) {
+    if (record.direction != XDWL_CAPTURE_RECEIVED)
+      continue;
+
+    if (mode == XDWL_REPLAY_TIMED) {
+      uint64_t at = start + record.time_ns;
+      struct timespec ts = {at / 1000000000, at % 1000000000};
+
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+             EINTR)
+        ;
+    }
+
+    // the real fds are gone, handlers get something they can close
+    size_t fd_count = record.fd_count;
+    if (fd_count > XDWL_PROXY_MAX_FDS)
+      fd_count = XDWL_PROXY_MAX_FDS;
+
+    for (size_t i = 0; i < fd_count; i++)
+      fds[i] = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+    if (xdwl_dispatch_bytes(replay->proxy, payload, record.length, fds,
+                            fd_count, &replay->skipped) == -1) {
+      r = -1;
+      break;
+    }
+
+    replay_drain(replay);
+    replay->records++;
+    replay->bytes += record.length;
+  }
+
+  free(payload);
+  return r == -1 ? -1 : 0;
+}
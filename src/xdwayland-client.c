@@ -1,13 +1,16 @@
 #include "xdwayland-collections.h"
 #include "xdwayland-core.h"
 #include "xdwayland-private.h"
+#include "xdwayland-stats.h"
 #include "xdwayland-types.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #define CLIENT_IDS_START 1
@@ -19,9 +22,16 @@
 #define CAP 4096
 #define MAX_ARGS 16
 #define HEADER_SIZE 8
+#define OBJECTS_PER_SLAB 64
+#define MAP_SIZE_HINT 64
+// a message's size field is 16 bits, so any message fits
+#define IN_BUFFER_SIZE (1 << 16)
+// same as libwayland's, a request is at most CAP
+#define OUT_BUFFER_SIZE CAP
 
 static const struct xdwl_interface *__interfaces[1024];
 static size_t __interface_count = 0;
+static xdwl_map *__interfaces_by_name = NULL;
 
 XDWL_MUST_CHECK
 static int xdwl_dispatch_message(xdwl_proxy *proxy,
@@ -44,16 +54,15 @@ static int xdwl_dispatch_message(xdwl_proxy *proxy,
   if (event_signature != NULL)
     xdwl_read_args(raw_message, event_args, event_signature);
 
-#ifdef LOGS
-  const char *object_name = object->name;
-  xdwl_log("INFO", "<- %s.#%ld.%s", object_name, raw_message->object_id,
-           event.name);
-  if (event_signature != NULL) {
-    xdwl_show_args(event_args + 1, event_signature);
-  } else {
-    printf("()\n");
-  }
-#endif
+  if (XDWL_TRACING())
+    xdwl_trace_message("<-", object, &event, event_args + 1);
+
+  struct xdwl_opcode_stats *stats =
+      XDWL_STAT_OPCODE(object->stats->events, raw_message->method_id);
+  XDWL_STAT_ADD(stats->messages, 1);
+  XDWL_STAT_ADD(stats->bytes, raw_message->body_length + HEADER_SIZE);
+  if (raw_message->fd >= 0)
+    XDWL_STAT_ADD(stats->fds, 1);
 
   struct xdwl_listener *listener =
       xdwl_map_get(proxy->event_listeners, raw_message->object_id);
@@ -66,65 +75,97 @@ static int xdwl_dispatch_message(xdwl_proxy *proxy,
       return 0;
     }
 
+    XDWL_PROBE(dispatch_start, raw_message->object_id, raw_message->method_id,
+               raw_message->body_length + HEADER_SIZE, raw_message->fd >= 0);
+
+    if (!__atomic_load_n(&proxy->time_handlers, __ATOMIC_RELAXED)) {
+      handler(listener->user_data, event_args);
+      XDWL_PROBE(dispatch_done, raw_message->object_id, raw_message->method_id);
+      return 0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
     handler(listener->user_data, event_args);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    XDWL_PROBE(dispatch_done, raw_message->object_id, raw_message->method_id);
+    XDWL_STAT_ADD(stats->handler_ns,
+                  (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+                      end.tv_nsec - start.tv_nsec);
   }
 
   return 0;
 };
 
-static const struct xdwl_interface *
-xdwl_interface_lookup(const char *interface_name) {
-  for (size_t i = 0; i < __interface_count; i++) {
-    const struct xdwl_interface *interface = __interfaces[i];
-    if (strcmp(interface->name, interface_name) == 0) {
-      return interface;
-    }
-  }
-  return NULL;
+const struct xdwl_interface *xdwl_interface_lookup(const char *interface_name) {
+  const struct xdwl_interface **interface;
+
+  if (__interfaces_by_name == NULL || interface_name == NULL)
+    return NULL;
+
+  interface = xdwl_map_get(__interfaces_by_name, (size_t)interface_name);
+  return interface ? *interface : NULL;
 }
 
 void xdwl_interface_register(const struct xdwl_interface *interface) {
   assert(__interface_count < (sizeof(__interfaces) / sizeof(void *)));
   __interfaces[__interface_count] = interface;
   __interface_count++;
+
+  if (__interfaces_by_name == NULL)
+    __interfaces_by_name = xdwl_map_new(MAP_SIZE_HINT);
+  assert(__interfaces_by_name != NULL);
+
+  void *slot = xdwl_map_set_str(__interfaces_by_name, interface->name,
+                                &interface, sizeof(interface));
+  assert(slot != NULL);
+  (void)slot;
 }
 
-static void xdwl_destroy_objects(xdwl_proxy *proxy) {
-  for (size_t i = 0; i < proxy->object_registry->size; i++) {
-    struct xdwl_map_pair *pair = proxy->object_registry->pairs[i];
-    while (pair) {
-      xdwl_object *o = pair->value;
-      free(o->name);
-      pair = pair->next;
-    }
+static void xdwl_remove_listener(xdwl_proxy *proxy, xdwl_id object_id) {
+  struct xdwl_listener *listener =
+      xdwl_map_get(proxy->event_listeners, object_id);
+
+  if (listener) {
+    xdwl_free(&proxy->accounts[XDWL_ALLOC_LISTENERS], listener->event_handlers,
+              listener->event_handlers_size);
+    xdwl_map_remove(proxy->event_listeners, object_id);
   }
+}
 
+static void xdwl_destroy_objects(xdwl_proxy *proxy) {
   xdwl_map_destroy(proxy->object_registry);
+  xdwl_pool_destroy(proxy->object_pool);
 }
+
 xdwl_object *xdwl_object_get_by_id(xdwl_proxy *proxy, xdwl_id object_id) {
-  xdwl_object *object = xdwl_map_get(proxy->object_registry, object_id);
+  xdwl_object **object = xdwl_map_get(proxy->object_registry, object_id);
 
   if (!object) {
     return NULL;
   }
 
-  return object;
+  return *object;
 }
 
 xdwl_object *xdwl_object_get_by_name(xdwl_proxy *proxy,
                                      const char *object_name) {
   xdwl_object *object = NULL;
+  struct xdwl_map_pair *pair;
 
-  for (size_t i = 0; i < proxy->object_registry->size; i++) {
-    struct xdwl_map_pair *pair = proxy->object_registry->pairs[i];
-    while (pair) {
-      xdwl_object *o = pair->value;
+  // object names are interned, so they compare by pointer
+  const char *name = xdwl_intern_lookup(object_name);
+  if (name == NULL)
+    return NULL;
 
-      if (strcmp(o->name, object_name) == 0 &&
-          (object == NULL || object->seq < o->seq)) {
-        object = o;
-      }
-      pair = pair->next;
+  xdwl_map_for_each(proxy->object_registry, pair) {
+    xdwl_object *o = *(xdwl_object **)pair->value;
+
+    if (o->name == name &&
+        (object == NULL || object->seq < o->seq)) {
+      object = o;
     }
   }
 
@@ -183,25 +224,47 @@ xdwl_id xdwl_object_register(xdwl_proxy *proxy, xdwl_id object_id,
       return 0;
   }
 
-  const struct xdwl_interface *interface = xdwl_interface_lookup(object_name);
+  const char *name = xdwl_intern_lookup(object_name);
+  const struct xdwl_interface *interface = xdwl_interface_lookup(name);
   if (interface == NULL) {
     xdwl_error_set(XDWLERR_NULLIFACE,
                    "xdwl_object_register: failed to register object %s.#%d. %s "
                    "interface not found",
                    object_name, o, object_name);
-    return 0;
+    goto err_id;
   }
 
-  xdwl_object object = {.id = o,
-                        .name = strdup(object_name),
-                        .interface = interface,
-                        .seq = proxy->seq++};
+  xdwl_object *object = xdwl_pool_alloc(proxy->object_pool);
+  if (object == NULL)
+    goto err_id;
 
-  if (xdwl_map_set(proxy->object_registry, o, &object, sizeof(xdwl_object)) ==
+  object->id = o;
+  object->name = name;
+  object->interface = interface;
+  object->seq = proxy->seq++;
+
+  object->stats = xdwl_stats_lookup(proxy, interface);
+  if (object->stats == NULL)
+    goto err_object;
+
+  if (xdwl_map_set(proxy->object_registry, o, &object, sizeof(object)) ==
       NULL)
-    return 0;
+    goto err_object;
 
   return o;
+
+err_object:
+  xdwl_pool_free(proxy->object_pool, object);
+err_id:
+  // the id is free again for the next register
+  if (SERVER_IDS_START <= o && o <= SERVER_IDS_END) {
+    if (xdwl_bitmap_unset(proxy->server_id_pool, o - SERVER_IDS_START) == -1)
+      xdwl_error_print();
+  } else {
+    if (xdwl_bitmap_unset(proxy->client_id_pool, o - CLIENT_IDS_START) == -1)
+      xdwl_error_print();
+  }
+  return 0;
 }
 
 int xdwl_object_unregister(xdwl_proxy *proxy, xdwl_id object_id) {
@@ -209,17 +272,18 @@ int xdwl_object_unregister(xdwl_proxy *proxy, xdwl_id object_id) {
 
   if (object) {
     if (SERVER_IDS_START <= object_id && object_id <= SERVER_IDS_END) {
-      object_id = object_id - SERVER_IDS_START;
-      if (xdwl_bitmap_unset(proxy->server_id_pool, object_id) == -1)
+      if (xdwl_bitmap_unset(proxy->server_id_pool,
+                            object_id - SERVER_IDS_START) == -1)
         return -1;
     } else {
-      object_id = object_id - CLIENT_IDS_START;
-      if (xdwl_bitmap_unset(proxy->client_id_pool, object_id) == -1)
+      if (xdwl_bitmap_unset(proxy->client_id_pool,
+                            object_id - CLIENT_IDS_START) == -1)
         return -1;
     }
 
-    free(object->name);
-    xdwl_map_remove(proxy->object_registry, object_id + 1);
+    xdwl_remove_listener(proxy, object_id);
+    xdwl_map_remove(proxy->object_registry, object_id);
+    xdwl_pool_free(proxy->object_pool, object);
     return 0;
   }
 
@@ -234,8 +298,9 @@ int xdwl_object_unregister_last(xdwl_proxy *proxy, const char *object_name) {
   xdwl_object *object = xdwl_object_get_by_name(proxy, object_name);
 
   if (object) {
-    free(object->name);
+    xdwl_remove_listener(proxy, object->id);
     xdwl_map_remove(proxy->object_registry, object->id);
+    xdwl_pool_free(proxy->object_pool, object);
     return 0;
   }
 
@@ -247,7 +312,11 @@ int xdwl_object_unregister_last(xdwl_proxy *proxy, const char *object_name) {
 }
 
 xdwl_proxy *xdwl_proxy_create() {
-  int sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  return xdwl_proxy_create_with_allocator(NULL);
+}
+
+xdwl_proxy *
+xdwl_proxy_create_with_allocator(const struct xdwl_allocator *allocator) {
   struct sockaddr_un sock_addr = {.sun_family = AF_UNIX};
 
   char *display = getenv("WAYLAND_DISPLAY");
@@ -268,52 +337,135 @@ xdwl_proxy *xdwl_proxy_create() {
   snprintf(socket_path, socket_path_len, "%s/%s", xdg_dir, display);
   strncpy(sock_addr.sun_path, socket_path, sizeof(sock_addr.sun_path) - 1);
 
+  int sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock_fd < 0) {
+    perror("socket");
+    xdwl_error_set(XDWLERR_SOCKCONN, "xdwl_init: failed to create a socket");
+    return NULL;
+  }
+
   if (connect(sock_fd, (struct sockaddr *)&sock_addr, sizeof(sock_addr)) < 0) {
     perror("connect");
     xdwl_error_set(XDWLERR_SOCKCONN, "xdwl_init: failed to connect to %s",
                    display);
+    close(sock_fd);
     return NULL;
   }
 
-  xdwl_proxy *proxy = malloc(sizeof(xdwl_proxy));
+  xdwl_proxy *proxy = xdwl_proxy_create_from_fd_with_allocator(sock_fd, allocator);
   if (proxy == NULL) {
-    perror("malloc");
-    xdwl_error_set(XDWLERR_STD, "xdwl_init: failed to malloc() proxy");
+    close(sock_fd);
     return NULL;
   }
 
-  proxy->client_id_pool = xdwl_bitmap_new(CAP);
-  if (!proxy->client_id_pool) {
-    free(proxy);
-    return NULL;
-  }
+  // a bad capture path shouldn't keep the client from connecting
+  const char *capture = getenv("XDWL_CAPTURE");
+  if (capture && *capture && xdwl_capture_start(proxy, capture) == -1)
+    xdwl_error_print();
 
-  proxy->server_id_pool = xdwl_bitmap_new(CAP);
-  if (!proxy->server_id_pool) {
-    xdwl_bitmap_destroy(proxy->client_id_pool);
-    free(proxy);
+  return proxy;
+}
+
+xdwl_proxy *xdwl_proxy_create_from_fd(int fd) {
+  return xdwl_proxy_create_from_fd_with_allocator(fd, NULL);
+}
+
+xdwl_proxy *
+xdwl_proxy_create_from_fd_with_allocator(int fd,
+                                         const struct xdwl_allocator *allocator) {
+  struct xdwl_alloc_account account = {
+      allocator ? allocator : &xdwl_libc_allocator, {0}};
+
+  xdwl_proxy *proxy = xdwl_alloc(&account, sizeof(xdwl_proxy));
+  if (proxy == NULL) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_init: failed to malloc() proxy");
     return NULL;
   }
 
-  proxy->sockfd = sock_fd;
-  proxy->object_registry = xdwl_map_new(CAP);
-  if (proxy->object_registry == NULL) {
-    xdwl_bitmap_destroy(proxy->client_id_pool);
-    xdwl_bitmap_destroy(proxy->server_id_pool);
-    free(proxy);
-    return NULL;
+  // the accounts point into the proxy, the proxy itself is counted once
+  // they exist
+  proxy->allocator = *account.allocator;
+  for (size_t i = 0; i < XDWL_ALLOC_SUBSYSTEMS; i++) {
+    proxy->accounts[i].allocator = &proxy->allocator;
+    memset(&proxy->accounts[i].stats, 0, sizeof(struct xdwl_alloc_stats));
   }
+  proxy->accounts[XDWL_ALLOC_OTHER].stats = account.stats;
 
-  proxy->event_listeners = xdwl_map_new(CAP);
-  if (proxy->event_listeners == NULL) {
-    xdwl_bitmap_destroy(proxy->client_id_pool);
-    xdwl_bitmap_destroy(proxy->server_id_pool);
-    xdwl_map_destroy(proxy->object_registry);
-    free(proxy);
-    return NULL;
+  proxy->in_buffer =
+      xdwl_alloc(&proxy->accounts[XDWL_ALLOC_BUFFERS], IN_BUFFER_SIZE);
+  if (proxy->in_buffer == NULL) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_init: failed to malloc() input buffer");
+    goto err_proxy;
+  }
+  proxy->in_start = 0;
+  proxy->in_end = 0;
+  proxy->in_fd_count = 0;
+  proxy->capture = NULL;
+
+  proxy->out_buffer =
+      xdwl_alloc(&proxy->accounts[XDWL_ALLOC_BUFFERS], OUT_BUFFER_SIZE);
+  if (proxy->out_buffer == NULL) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_init: failed to malloc() output buffer");
+    goto err_in_buffer;
   }
+  proxy->out_length = 0;
+  proxy->corked = 0;
+
+  proxy->client_id_pool =
+      xdwl_bitmap_new_in(CAP, &proxy->accounts[XDWL_ALLOC_BITMAPS]);
+  if (!proxy->client_id_pool)
+    goto err_out_buffer;
+
+  proxy->server_id_pool =
+      xdwl_bitmap_new_in(CAP, &proxy->accounts[XDWL_ALLOC_BITMAPS]);
+  if (!proxy->server_id_pool)
+    goto err_client_ids;
+
+  proxy->sockfd = fd;
+  proxy->seq = 0;
+  proxy->object_registry =
+      xdwl_map_new_in(MAP_SIZE_HINT, &proxy->accounts[XDWL_ALLOC_REGISTRY]);
+  if (proxy->object_registry == NULL)
+    goto err_server_ids;
+
+  proxy->object_pool =
+      xdwl_pool_new_in(sizeof(xdwl_object), OBJECTS_PER_SLAB,
+                       &proxy->accounts[XDWL_ALLOC_REGISTRY]);
+  if (proxy->object_pool == NULL)
+    goto err_registry;
+
+  proxy->event_listeners =
+      xdwl_map_new_in(MAP_SIZE_HINT, &proxy->accounts[XDWL_ALLOC_LISTENERS]);
+  if (proxy->event_listeners == NULL)
+    goto err_object_pool;
+
+  if (xdwl_stats_init(proxy) == -1)
+    goto err_listeners;
 
   return proxy;
+
+err_listeners:
+  xdwl_map_destroy(proxy->event_listeners);
+err_object_pool:
+  xdwl_pool_destroy(proxy->object_pool);
+err_registry:
+  xdwl_map_destroy(proxy->object_registry);
+err_server_ids:
+  xdwl_bitmap_destroy(proxy->server_id_pool);
+err_client_ids:
+  xdwl_bitmap_destroy(proxy->client_id_pool);
+err_out_buffer:
+  xdwl_free(&proxy->accounts[XDWL_ALLOC_BUFFERS], proxy->out_buffer,
+            OUT_BUFFER_SIZE);
+err_in_buffer:
+  xdwl_free(&proxy->accounts[XDWL_ALLOC_BUFFERS], proxy->in_buffer,
+            IN_BUFFER_SIZE);
+err_proxy:
+  xdwl_free(&account, proxy, sizeof(xdwl_proxy));
+  return NULL;
 }
 
 void xdwl_proxy_destroy(xdwl_proxy *proxy) {
@@ -322,16 +474,38 @@ void xdwl_proxy_destroy(xdwl_proxy *proxy) {
 
     struct xdwl_map_pair *p;
     xdwl_map_for_each(proxy->event_listeners, p) {
-      struct xdwl_listener *l = p->value;
-      free(l->event_handlers);
+      struct xdwl_listener *l = (struct xdwl_listener *)p->value;
+      xdwl_free(&proxy->accounts[XDWL_ALLOC_LISTENERS], l->event_handlers,
+                l->event_handlers_size);
     }
     xdwl_map_destroy(proxy->event_listeners);
 
     xdwl_bitmap_destroy(proxy->client_id_pool);
     xdwl_bitmap_destroy(proxy->server_id_pool);
+    xdwl_stats_finish(proxy);
+
+    // fds that came in with events nobody dispatched
+    for (size_t i = 0; i < proxy->in_fd_count; i++)
+      close(proxy->in_fds[i]);
+    xdwl_free(&proxy->accounts[XDWL_ALLOC_BUFFERS], proxy->in_buffer,
+              IN_BUFFER_SIZE);
+
+    // corked requests nobody flushed still go out, a destroy request is
+    // often the last thing queued
+    if (xdwl_proxy_flush(proxy) == -1)
+      xdwl_error_print();
+    xdwl_free(&proxy->accounts[XDWL_ALLOC_BUFFERS], proxy->out_buffer,
+              OUT_BUFFER_SIZE);
+
+    // after the flush, so what it sent is in the capture too
+    xdwl_capture_stop(proxy);
 
     close(proxy->sockfd);
-    free(proxy);
+
+    // the allocator lives in the proxy being freed
+    struct xdwl_allocator allocator = proxy->allocator;
+    struct xdwl_alloc_account account = {&allocator, {0}};
+    xdwl_free(&account, proxy, sizeof(xdwl_proxy));
   }
 };
 
@@ -348,14 +522,49 @@ int xdwl_add_listener(xdwl_proxy *proxy, const char *object_name,
     return -1;
   }
 
-  struct xdwl_listener listener = {
-      .user_data = user_data, .event_handlers = malloc(event_handlers_size)};
-  memcpy(listener.event_handlers, event_handlers, event_handlers_size);
+  return xdwl_add_listener_by_id(proxy, object->id, event_handlers,
+                                 event_handlers_size, user_data);
+}
 
-  size_t object_id = object->id;
-  if (xdwl_map_set(proxy->event_listeners, object_id, &listener,
-                   sizeof(struct xdwl_listener)) == NULL)
+int xdwl_add_listener_by_id(xdwl_proxy *proxy, xdwl_id object_id,
+                            void *event_handlers, size_t event_handlers_size,
+                            void *user_data) {
+  if (!xdwl_object_get_by_id(proxy, object_id)) {
+    xdwl_error_set(XDWLERR_NULLOBJ,
+                   "xdwl_add_listener: no registered object with id %u",
+                   object_id);
     return -1;
+  }
+
+  int inserted;
+  struct xdwl_listener *listener =
+      xdwl_map_get_or_insert(proxy->event_listeners, object_id,
+                             sizeof(struct xdwl_listener), &inserted);
+  if (listener == NULL)
+    return -1;
+
+  // re-adding a listener to the same object replaces it in place
+  if (!inserted && listener->event_handlers_size != event_handlers_size) {
+    xdwl_free(&proxy->accounts[XDWL_ALLOC_LISTENERS], listener->event_handlers,
+              listener->event_handlers_size);
+    listener->event_handlers = NULL;
+  }
+
+  if (listener->event_handlers == NULL) {
+    listener->event_handlers =
+        xdwl_alloc(&proxy->accounts[XDWL_ALLOC_LISTENERS], event_handlers_size);
+    if (listener->event_handlers == NULL) {
+      perror("malloc");
+      xdwl_error_set(XDWLERR_STD,
+                     "xdwl_add_listener: failed to malloc() event handlers");
+      xdwl_map_remove(proxy->event_listeners, object_id);
+      return -1;
+    }
+  }
+
+  memcpy(listener->event_handlers, event_handlers, event_handlers_size);
+  listener->event_handlers_size = event_handlers_size;
+  listener->user_data = user_data;
 
   return 0;
 }
@@ -381,9 +590,16 @@ static ssize_t xdwl_sock_send(xdwl_proxy *proxy, char *buffer,
     c->cmsg_len = CMSG_LEN(sizeof(fd));
     *(int *)CMSG_DATA(c) = fd;
 
-    return sendmsg(proxy->sockfd, &m, 0);
+    ssize_t n = sendmsg(proxy->sockfd, &m, 0);
+    if (n > 0 && proxy->capture)
+      xdwl_capture_write(proxy, XDWL_CAPTURE_SENT, buffer, n, 1);
+    return n;
   }
-  return send(proxy->sockfd, buffer, buffer_len, 0);
+
+  ssize_t n = send(proxy->sockfd, buffer, buffer_len, 0);
+  if (n > 0 && proxy->capture)
+    xdwl_capture_write(proxy, XDWL_CAPTURE_SENT, buffer, n, 0);
+  return n;
 };
 
 int xdwl_send_request(xdwl_proxy *proxy, xdwl_id object_id, char *object_name,
@@ -449,77 +665,245 @@ int xdwl_send_request(xdwl_proxy *proxy, xdwl_id object_id, char *object_name,
     request_args[i] = arg;
   }
 
-#ifdef LOGS
-  xdwl_log("INFO", "-> %s.#%ld.%s", object_name, object_id, request.name);
-  if (request_signature != NULL) {
-    xdwl_show_args(request_args, request_signature);
-  } else {
-    printf("()\n");
-  }
-#endif
+  if (XDWL_TRACING())
+    xdwl_trace_message("->", object, &request, request_args);
 
   size_t message_size =
       HEADER_SIZE +
       xdwl_calculate_body_size(request_args, arg_count, request_signature);
   size_t offset = 0;
 
-  char buffer[CAP];
+  // corked requests are written straight into the output buffer. one
+  // carrying an fd still goes out now, behind what's queued, since the
+  // caller may close the fd as soon as this returns
+  int queue = proxy->corked && fd <= 0;
+  if (proxy->out_length &&
+      (!queue || proxy->out_length + message_size > OUT_BUFFER_SIZE) &&
+      xdwl_proxy_flush(proxy) == -1)
+    return -1;
+
+  char stack_buffer[CAP];
+  char *buffer = queue ? proxy->out_buffer + proxy->out_length : stack_buffer;
 
   xdwl_buf_write_u32(buffer, &offset, object_id);
   xdwl_buf_write_u16(buffer, &offset, method_id);
   xdwl_buf_write_u16(buffer, &offset, message_size);
   xdwl_write_args(buffer, &offset, request_args, arg_count, request_signature);
 
-  int n = xdwl_sock_send(proxy, buffer, message_size, fd);
-  if (n < 0) {
-    xdwl_error_set(XDWLERR_SOCKSEND,
-                   "xdwl_send_request: failed to send message");
-    return -1;
+  XDWL_PROBE(send, object_id, method_id, message_size, fd > 0);
+
+  if (queue) {
+    proxy->out_length += message_size;
+  } else {
+    int n = xdwl_sock_send(proxy, buffer, message_size, fd);
+    XDWL_STAT_ADD(proxy->io.send_calls, 1);
+    if (n < 0) {
+      xdwl_error_set(XDWLERR_SOCKSEND,
+                     "xdwl_send_request: failed to send message");
+      return -1;
+    }
+    XDWL_STAT_ADD(proxy->io.bytes_sent, n);
   }
 
+  struct xdwl_opcode_stats *stats =
+      XDWL_STAT_OPCODE(object->stats->requests, method_id);
+  XDWL_STAT_ADD(stats->messages, 1);
+  XDWL_STAT_ADD(stats->bytes, message_size);
+  if (fd > 0)
+    XDWL_STAT_ADD(stats->fds, 1);
+
   return 0;
 }
 
-static ssize_t xdwl_sock_recv(xdwl_proxy *proxy, char *buffer, int *fd) {
-  char cmsg[CMSG_SPACE(sizeof(int))];
-  struct iovec e = {buffer, CAP};
-  struct msghdr m = {NULL, 0, &e, 1, cmsg, sizeof(cmsg), 0};
+int xdwl_proxy_flush(xdwl_proxy *proxy) {
+  size_t written = 0;
+
+  // a full socket buffer takes what fits, the rest goes in the next send
+  while (written < proxy->out_length) {
+    ssize_t n = xdwl_sock_send(proxy, proxy->out_buffer + written,
+                               proxy->out_length - written, 0);
+    XDWL_STAT_ADD(proxy->io.send_calls, 1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      perror("send");
+      xdwl_error_set(XDWLERR_SOCKSEND,
+                     "xdwl_proxy_flush: failed to send %zu queued bytes",
+                     proxy->out_length - written);
+
+      // what did go out mustn't be sent twice
+      memmove(proxy->out_buffer, proxy->out_buffer + written,
+              proxy->out_length - written);
+      proxy->out_length -= written;
+      return -1;
+    }
+    XDWL_STAT_ADD(proxy->io.bytes_sent, n);
+    written += n;
+  }
 
-  ssize_t n = recvmsg(proxy->sockfd, &m, 0);
-  struct cmsghdr *c = CMSG_FIRSTHDR(&m);
-  if (c != NULL)
-    *fd = *(int *)CMSG_DATA(c);
+  proxy->out_length = 0;
+  return 0;
+}
 
-  return n;
+void xdwl_proxy_cork(xdwl_proxy *proxy) { proxy->corked = 1; }
+
+int xdwl_proxy_uncork(xdwl_proxy *proxy) {
+  proxy->corked = 0;
+  return xdwl_proxy_flush(proxy);
 }
 
-static int xdwl_recv_events(xdwl_proxy *proxy, char *buffer,
-                            struct xdwl_raw_message *message, int *offset,
-                            int *received) {
-  int fd = 0;
+// appends to the input buffer, after moving whatever is left of it to the
+// front. fds are queued until the message carrying them is read
+static void xdwl_in_compact(xdwl_proxy *proxy) {
+  if (proxy->in_start > 0) {
+    memmove(proxy->in_buffer, proxy->in_buffer + proxy->in_start,
+            proxy->in_end - proxy->in_start);
+    proxy->in_end -= proxy->in_start;
+    proxy->in_start = 0;
+  }
+}
+
+static void xdwl_in_queue_fd(xdwl_proxy *proxy, int fd) {
+  if (proxy->in_fd_count < XDWL_PROXY_MAX_FDS)
+    proxy->in_fds[proxy->in_fd_count++] = fd;
+  else
+    close(fd);
+}
 
-  if (*received == 0) {
-    *received = xdwl_sock_recv(proxy, buffer, &fd);
-    if (!*received) {
-      xdwl_error_set(XDWLERR_SOCKRECV, "xdwl_recv_events: server is gone");
+// fds the messages buffered from in_start on will take, the way
+// xdwl_next_message hands them out. -1 if a header isn't all there yet
+static ssize_t xdwl_in_fds_claimed(xdwl_proxy *proxy) {
+  size_t offset = proxy->in_start;
+  ssize_t claimed = 0;
+
+  while (offset + HEADER_SIZE <= proxy->in_end) {
+    size_t start = offset;
+    xdwl_id object_id = xdwl_buf_read_u32(proxy->in_buffer, &offset);
+    uint16_t method_id = xdwl_buf_read_u16(proxy->in_buffer, &offset);
+    uint16_t message_size = xdwl_buf_read_u16(proxy->in_buffer, &offset);
+
+    if (message_size < HEADER_SIZE)
       return -1;
+
+    xdwl_object *object = xdwl_object_get_by_id(proxy, object_id);
+    if (object && method_id < object->interface->event_count) {
+      const char *signature = object->interface->events[method_id].signature;
+      if (signature && strchr(signature, 'h'))
+        claimed++;
     }
+
+    offset = start + message_size;
   }
 
-  if (*offset + HEADER_SIZE > *received)
+  return offset < proxy->in_end ? -1 : claimed;
+}
+
+// fds are queued in order and arrive with the first byte of their message,
+// any beyond what the buffered messages take belonged to ones already
+// consumed without being dispatched
+static void xdwl_in_drop_unclaimed_fds(xdwl_proxy *proxy) {
+  ssize_t claimed = xdwl_in_fds_claimed(proxy);
+
+  while (claimed >= 0 && proxy->in_fd_count > (size_t)claimed) {
+    close(proxy->in_fds[0]);
+    proxy->in_fd_count--;
+    memmove(proxy->in_fds, proxy->in_fds + 1,
+            proxy->in_fd_count * sizeof(int));
+  }
+}
+
+static ssize_t xdwl_sock_recv(xdwl_proxy *proxy) {
+  char cmsg[CMSG_SPACE(sizeof(int) * XDWL_PROXY_MAX_FDS)];
+  size_t fd_total = 0;
+
+  xdwl_in_compact(proxy);
+
+  struct iovec e = {proxy->in_buffer + proxy->in_end,
+                    IN_BUFFER_SIZE - proxy->in_end};
+  struct msghdr m = {NULL, 0, &e, 1, cmsg, sizeof(cmsg), 0};
+
+  ssize_t n = recvmsg(proxy->sockfd, &m, MSG_CMSG_CLOEXEC);
+  XDWL_STAT_ADD(proxy->io.recv_calls, 1);
+  if (n <= 0)
+    return n;
+
+  XDWL_STAT_ADD(proxy->io.bytes_received, n);
+
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&m); c != NULL;
+       c = CMSG_NXTHDR(&m, c)) {
+    if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    size_t fd_count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int *fds = (int *)CMSG_DATA(c);
+
+    for (size_t i = 0; i < fd_count; i++)
+      xdwl_in_queue_fd(proxy, fds[i]);
+    fd_total += fd_count;
+  }
+
+  XDWL_PROBE(recv, n, fd_total);
+
+  if (proxy->capture)
+    xdwl_capture_write(proxy, XDWL_CAPTURE_RECEIVED,
+                       proxy->in_buffer + proxy->in_end, n, fd_total);
+
+  proxy->in_end += n;
+  return n;
+}
+
+// blocks until more bytes arrive
+static int xdwl_recv_events(xdwl_proxy *proxy) {
+  // whatever is corked may be what the server has to answer first
+  if (xdwl_proxy_flush(proxy) == -1)
+    return -1;
+
+  ssize_t n = xdwl_sock_recv(proxy);
+
+  if (n == 0) {
+    xdwl_error_set(XDWLERR_SOCKRECV, "xdwl_recv_events: server is gone");
+    return -1;
+  }
+
+  if (n < 0) {
+    if (errno == EINTR)
+      return 0;
+
+    perror("recvmsg");
+    xdwl_error_set(XDWLERR_SOCKRECV, "xdwl_recv_events: failed to receive");
+    return -1;
+  }
+
+  return 0;
+}
+
+// 1 with message filled in if a whole one is buffered, 0 if it needs more
+// bytes. message->body points into the input buffer and is only valid
+// until the next read
+static int xdwl_next_message(xdwl_proxy *proxy,
+                             struct xdwl_raw_message *message) {
+  size_t available = proxy->in_end - proxy->in_start;
+  size_t offset = proxy->in_start;
+
+  if (available < HEADER_SIZE)
     return 0;
 
-  size_t _offset = *offset;
+  xdwl_id object_id = xdwl_buf_read_u32(proxy->in_buffer, &offset);
+  uint16_t method_id = xdwl_buf_read_u16(proxy->in_buffer, &offset);
+  uint16_t message_size = xdwl_buf_read_u16(proxy->in_buffer, &offset);
+
+  if (message_size < HEADER_SIZE) {
+    xdwl_error_set(XDWLERR_SOCKRECV,
+                   "xdwl_recv_events: malformed message of %d bytes",
+                   message_size);
+    return -1;
+  }
 
-  xdwl_id object_id = xdwl_buf_read_u32(buffer, &_offset);
-  uint16_t method_id = xdwl_buf_read_u16(buffer, &_offset);
-  uint16_t message_size = xdwl_buf_read_u16(buffer, &_offset);
+  if (message_size > available)
+    return 0;
 
-  message->object_id = object_id;
-  message->method_id = method_id;
-  message->body_length = message_size - HEADER_SIZE;
-  message->body = buffer + _offset;
-  message->fd = fd;
+  proxy->in_start += message_size;
 
   xdwl_object *object = xdwl_object_get_by_id(proxy, object_id);
   if (object == NULL) {
@@ -529,7 +913,29 @@ static int xdwl_recv_events(xdwl_proxy *proxy, char *buffer,
     return -1;
   }
 
-  *offset += message_size;
+  // the tables are indexed with it, a bad server or a replayed capture
+  // could point past them
+  if (method_id >= object->interface->event_count) {
+    xdwl_error_set(XDWLERR_NULLEVENT,
+                   "xdwl_recv_events: %s has no event %d", object->name,
+                   method_id);
+    return -1;
+  }
+
+  message->object_id = object_id;
+  message->method_id = method_id;
+  message->body_length = message_size - HEADER_SIZE;
+  message->body = proxy->in_buffer + offset;
+  message->fd = -1;
+
+  const char *signature = object->interface->events[method_id].signature;
+  if (signature && strchr(signature, 'h') && proxy->in_fd_count > 0) {
+    message->fd = proxy->in_fds[0];
+    proxy->in_fd_count--;
+    memmove(proxy->in_fds, proxy->in_fds + 1,
+            proxy->in_fd_count * sizeof(int));
+  }
+
   return 1;
 }
 
@@ -539,52 +945,97 @@ int xdwl_roundtrip(xdwl_proxy *proxy) {
     return -1;
   }
 
+  XDWL_PROBE(roundtrip_start, callback_id);
+
   if (xdwl_display_sync(proxy, callback_id) == -1)
     return -1;
 
-  uint8_t loop = 1;
-  while (loop) {
-    char buffer[CAP];
-    int offset = 0;
-    int received = 0;
-    int n;
-
+  for (;;) {
     struct xdwl_raw_message message;
+    int n;
 
-    while ((n = xdwl_recv_events(proxy, buffer, &message, &offset, &received)) >
-           0) {
-      if (n == -1) {
-        loop = 0;
-        break;
-      }
-      if (xdwl_dispatch_message(proxy, &message) == -1) {
+    while ((n = xdwl_next_message(proxy, &message)) > 0) {
+      if (xdwl_dispatch_message(proxy, &message) == -1)
         return -1;
-      }
+
+      // anything after done stays buffered for the next dispatch. the
+      // callback is dead once done, free its id so repeated roundtrips
+      // don't grow the registry
       if (message.object_id == callback_id) {
-        loop = 0;
+        XDWL_PROBE(roundtrip_done, callback_id);
+        return xdwl_object_unregister(proxy, callback_id);
       }
     }
-  }
 
-  return 0;
+    if (n == -1 || xdwl_recv_events(proxy) == -1)
+      return -1;
+  }
 }
 
 int xdwl_dispatch(xdwl_proxy *proxy) {
-  char buffer[CAP];
-  int offset = 0;
-  int received = 0;
+  struct xdwl_raw_message message;
   int n;
 
-  struct xdwl_raw_message message;
+  // only block if nothing complete is buffered already
+  if ((n = xdwl_next_message(proxy, &message)) == 0) {
+    if (xdwl_recv_events(proxy) == -1)
+      return -1;
 
-  while ((n = xdwl_recv_events(proxy, buffer, &message, &offset, &received)) >
-         0) {
-    if (n == -1)
-      break;
-    if (xdwl_dispatch_message(proxy, &message) == -1) {
+    n = xdwl_next_message(proxy, &message);
+  }
+
+  while (n > 0) {
+    if (xdwl_dispatch_message(proxy, &message) == -1)
       return -1;
-    }
+
+    n = xdwl_next_message(proxy, &message);
   }
 
   return n;
 };
+
+int xdwl_dispatch_bytes(xdwl_proxy *proxy, const char *data, size_t length,
+                        const int *fds, size_t fd_count, uint64_t *skipped) {
+  struct xdwl_raw_message message;
+  int n;
+
+  xdwl_in_compact(proxy);
+
+  if (length > IN_BUFFER_SIZE - proxy->in_end) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_dispatch_bytes: %zu bytes don't fit the input buffer",
+                   length);
+    return -1;
+  }
+
+  memcpy(proxy->in_buffer + proxy->in_end, data, length);
+  proxy->in_end += length;
+
+  for (size_t i = 0; i < fd_count; i++)
+    xdwl_in_queue_fd(proxy, fds[i]);
+
+  // a message skipped while the next header was still split may have
+  // left its fd behind
+  if (skipped)
+    xdwl_in_drop_unclaimed_fds(proxy);
+
+  for (;;) {
+    n = xdwl_next_message(proxy, &message);
+
+    // the message is already consumed. with no signature to say whether it
+    // carried an fd, drop whatever the messages after it won't take
+    if (n == -1 && skipped &&
+        (xdwl_error_get_code() == XDWLERR_NULLOBJ ||
+         xdwl_error_get_code() == XDWLERR_NULLEVENT)) {
+      xdwl_in_drop_unclaimed_fds(proxy);
+      (*skipped)++;
+      continue;
+    }
+
+    if (n <= 0)
+      return n;
+
+    if (xdwl_dispatch_message(proxy, &message) == -1)
+      return -1;
+  }
+}
@@ -1,5 +1,7 @@
+#include "xdwayland-collections.h"
 #include "xdwayland-private.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,114 +18,322 @@ static size_t hash_string(const char *string) {
   return hash;
 }
 
-xdwl_map *xdwl_map_new(size_t size) {
-  xdwl_map *m = malloc(sizeof(xdwl_map));
+#define MAP_MIN_SIZE 8
+#define MAP_REHASH_STEP 8
+#define MAP_MOVED ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+static unsigned int map_shift(size_t size) {
+  unsigned int bits = 0;
+  while (((size_t)1 << bits) < size)
+    bits++;
+
+  return 64 - bits;
+}
+
+// fibonacci hashing, the top bits of the product pick the home slot
+static size_t map_index(size_t key, unsigned int shift) {
+  return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
+static struct xdwl_map_pair *map_find(char *slots, size_t size, size_t stride,
+                                      unsigned int shift, size_t key) {
+  size_t mask = size - 1;
+  size_t i = map_index(key, shift);
+
+  for (size_t distance = 1;; distance++, i = (i + 1) & mask) {
+    struct xdwl_map_pair *pair = xdwl_map_slot(slots, stride, i);
+
+    // robin hood invariant: key would have displaced this pair
+    if ((pair->distance & ~MAP_MOVED) < distance)
+      return NULL;
+
+    if (pair->key == key && !(pair->distance & MAP_MOVED))
+      return pair;
+  }
+}
+
+static void *map_insert(xdwl_map *m, size_t key, void *value,
+                        size_t value_size) {
+  size_t mask = m->size - 1;
+  size_t i = map_index(key, m->shift);
+  size_t carry[m->stride / sizeof(size_t)];
+  size_t swap[m->stride / sizeof(size_t)];
+  struct xdwl_map_pair *entry = (struct xdwl_map_pair *)carry;
+  void *placed = NULL;
+
+  entry->key = key;
+  entry->distance = 1;
+  if (value) {
+    memcpy(entry->value, value, value_size);
+    memset(entry->value + value_size, 0, m->value_size - value_size);
+  } else {
+    memset(entry->value, 0, m->value_size);
+  }
+
+  for (;; i = (i + 1) & mask, entry->distance++) {
+    struct xdwl_map_pair *pair = xdwl_map_slot(m->slots, m->stride, i);
+
+    if (pair->distance == 0) {
+      memcpy(pair, entry, m->stride);
+      m->count++;
+      return placed ? placed : pair->value;
+    }
+
+    if (pair->distance < entry->distance) {
+      memcpy(swap, pair, m->stride);
+      memcpy(pair, entry, m->stride);
+      memcpy(entry, swap, m->stride);
+
+      if (!placed)
+        placed = pair->value;
+    }
+  }
+}
+
+static void map_rehash_step(xdwl_map *m, size_t steps) {
+  if (!m->old_slots)
+    return;
+
+  for (size_t n = 0; n < steps && m->old_index < m->old_size;
+       n++, m->old_index++) {
+    struct xdwl_map_pair *pair =
+        xdwl_map_slot(m->old_slots, m->stride, m->old_index);
+
+    if (pair->distance && !(pair->distance & MAP_MOVED)) {
+      map_insert(m, pair->key, pair->value, m->value_size);
+      pair->distance |= MAP_MOVED;
+      m->old_count--;
+    }
+  }
+
+  if (m->old_index == m->old_size) {
+    xdwl_free(m->account, m->old_slots, m->old_size * m->stride);
+    m->old_slots = NULL;
+    m->old_size = 0;
+    m->old_count = 0;
+    m->old_index = 0;
+  }
+}
+
+static int map_grow(xdwl_map *m) {
+  xdwl_map_flush(m);
+
+  size_t size = m->size * 2;
+  char *slots = xdwl_alloc_zeroed(m->account, size * m->stride);
+  if (!slots) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_map_set: failed to calloc() slots");
+    return -1;
+  }
+
+  m->old_slots = m->slots;
+  m->old_size = m->size;
+  m->old_count = m->count;
+  m->old_shift = m->shift;
+  m->old_index = 0;
+
+  m->slots = slots;
+  m->size = size;
+  m->shift = map_shift(size);
+  m->count = 0;
+
+  return 0;
+}
+
+static void map_erase(xdwl_map *m, struct xdwl_map_pair *pair) {
+  size_t mask = m->size - 1;
+  size_t i = ((char *)pair - m->slots) / m->stride;
+
+  // backward shift deletion, no tombstones in the live table
+  for (;;) {
+    size_t j = (i + 1) & mask;
+    struct xdwl_map_pair *next = xdwl_map_slot(m->slots, m->stride, j);
+    struct xdwl_map_pair *cur = xdwl_map_slot(m->slots, m->stride, i);
+
+    if (next->distance <= 1) {
+      cur->distance = 0;
+      break;
+    }
+
+    memcpy(cur, next, m->stride);
+    cur->distance--;
+    i = j;
+  }
+
+  m->count--;
+}
+
+xdwl_map *xdwl_map_new(size_t size) { return xdwl_map_new_in(size, NULL); }
+
+xdwl_map *xdwl_map_new_in(size_t size, struct xdwl_alloc_account *account) {
+  xdwl_map *m = xdwl_alloc(account, sizeof(xdwl_map));
   if (m == NULL) {
     perror("malloc");
     xdwl_error_set(XDWLERR_STD, "xdwl_map_new: failed to malloc()");
     return NULL;
   }
 
-  m->size = size;
-  m->pairs = calloc(size, sizeof(void *));
-  if (m->pairs == NULL) {
-    perror("calloc");
-    xdwl_error_set(XDWLERR_STD, "xdwl_map_new: failed to calloc()");
-    free(m);
-    return NULL;
-  }
+  m->size = MAP_MIN_SIZE;
+  while (m->size < size)
+    m->size <<= 1;
+
+  // slots are allocated by the first xdwl_map_set, once value size is known
+  m->slots = NULL;
+  m->shift = map_shift(m->size);
+  m->count = 0;
+  m->stride = 0;
+  m->value_size = 0;
+  m->max_load = XDWL_MAP_DEFAULT_MAX_LOAD;
+
+  m->old_slots = NULL;
+  m->old_size = 0;
+  m->old_count = 0;
+  m->old_index = 0;
+  m->old_shift = 0;
+
+  m->account = account;
 
   return m;
 }
 
 void xdwl_map_destroy(xdwl_map *m) {
-  if (m) {
-    for (size_t i = 0; i < m->size; i++) {
-      struct xdwl_map_pair *pair = m->pairs[i];
-      while (pair) {
-        struct xdwl_map_pair *next = pair->next;
-        free(pair->value);
-        free(pair);
-        pair = next;
-      }
-    }
-  }
+  if (!m)
+    return;
 
-  free(m->pairs);
-  free(m);
+  xdwl_free(m->account, m->slots, m->size * m->stride);
+  xdwl_free(m->account, m->old_slots, m->old_size * m->stride);
+  xdwl_free(m->account, m, sizeof(xdwl_map));
 }
 
-void *xdwl_map_set(xdwl_map *m, size_t key, void *value, size_t value_size) {
-  size_t n = key % m->size;
+void xdwl_map_set_max_load(xdwl_map *m, float max_load) {
+  if (max_load < 0.25f)
+    max_load = 0.25f;
+  if (max_load > 0.95f)
+    max_load = 0.95f;
 
-  struct xdwl_map_pair *new_pair = malloc(sizeof(struct xdwl_map_pair));
-  struct xdwl_map_pair *current_pair = m->pairs[n];
+  m->max_load = max_load;
+}
 
-  new_pair->prev = NULL;
-  new_pair->next = current_pair;
-  new_pair->key = key;
+void xdwl_map_flush(xdwl_map *m) { map_rehash_step(m, SIZE_MAX); }
+
+void *xdwl_map_get_or_insert(xdwl_map *m, size_t key, size_t value_size,
+                             int *inserted) {
+  if (!m->slots) {
+    m->value_size = value_size;
+    m->stride = (sizeof(struct xdwl_map_pair) + value_size +
+                 sizeof(size_t) - 1) &
+                ~(sizeof(size_t) - 1);
+
+    m->slots = xdwl_alloc_zeroed(m->account, m->size * m->stride);
+    if (!m->slots) {
+      perror("calloc");
+      xdwl_error_set(XDWLERR_STD,
+                     "xdwl_map_get_or_insert: failed to calloc() slots");
+      return NULL;
+    }
 
-  new_pair->value = malloc(value_size);
-  if (!new_pair) {
-    perror("malloc");
-    xdwl_error_set(XDWLERR_STD, "xdwl_map_set: failed to malloc() new value");
+  } else if (value_size > m->value_size) {
+    xdwl_error_set(
+        XDWLERR_OUTOFRANGE,
+        "xdwl_map_get_or_insert: %ld byte value doesn't fit %ld byte slots",
+        value_size, m->value_size);
     return NULL;
   }
-  memcpy(new_pair->value, value, value_size);
-  if (current_pair) {
-    current_pair->prev = new_pair;
+
+  map_rehash_step(m, MAP_REHASH_STEP);
+
+  if (inserted)
+    *inserted = 0;
+
+  struct xdwl_map_pair *pair =
+      map_find(m->slots, m->size, m->stride, m->shift, key);
+  if (pair)
+    return pair->value;
+
+  // not migrated yet, move it over now. the total count doesn't change
+  if (m->old_slots) {
+    pair = map_find(m->old_slots, m->old_size, m->stride, m->old_shift, key);
+    if (pair) {
+      pair->distance |= MAP_MOVED;
+      m->old_count--;
+      return map_insert(m, key, pair->value, m->value_size);
+    }
   }
 
-  m->pairs[n] = new_pair;
+  if (m->count + m->old_count + 1 > m->size * m->max_load &&
+      map_grow(m) == -1)
+    return NULL;
+
+  if (inserted)
+    *inserted = 1;
+
+  return map_insert(m, key, NULL, 0);
+}
+
+void *xdwl_map_set(xdwl_map *m, size_t key, void *value, size_t value_size) {
+  void *slot = xdwl_map_get_or_insert(m, key, value_size, NULL);
+  if (!slot)
+    return NULL;
 
-  return new_pair->value;
+  memcpy(slot, value, value_size);
+  return slot;
 };
 
 void *xdwl_map_set_str(xdwl_map *m, const char *key_str, void *value,
                        size_t value_size) {
-  size_t key = hash_string(key_str);
-  return xdwl_map_set(m, key, value, value_size);
+  const char *key = xdwl_intern(key_str);
+  if (!key)
+    return NULL;
+
+  return xdwl_map_set(m, (size_t)key, value, value_size);
 };
 
-void xdwl_map_remove(xdwl_map *m, size_t key) {
-  size_t n = key % m->size;
-  struct xdwl_map_pair *pair = m->pairs[n];
+void *xdwl_map_get_or_insert_str(xdwl_map *m, const char *key_str,
+                                 size_t value_size, int *inserted) {
+  const char *key = xdwl_intern(key_str);
+  if (!key)
+    return NULL;
 
-  for (; pair && pair->key != key; pair = pair->next)
-    ;
+  return xdwl_map_get_or_insert(m, (size_t)key, value_size, inserted);
+}
 
-  if (pair) {
-    if (!pair->prev && !pair->next) { // first and only
-      m->pairs[n] = NULL;
+void xdwl_map_remove(xdwl_map *m, size_t key) {
+  if (!m->slots)
+    return;
 
-    } else if (!pair->prev) { // first
-      pair->next->prev = NULL;
-      m->pairs[n] = pair->next;
+  map_rehash_step(m, MAP_REHASH_STEP);
 
-    } else if (!pair->next) { // last
-      pair->prev->next = NULL;
+  struct xdwl_map_pair *pair =
+      map_find(m->slots, m->size, m->stride, m->shift, key);
+  if (pair) {
+    map_erase(m, pair);
+    return;
+  }
 
-    } else { // middle
-      pair->prev->next = pair->next;
-      pair->next->prev = pair->prev;
+  if (m->old_slots) {
+    pair = map_find(m->old_slots, m->old_size, m->stride, m->old_shift, key);
+    if (pair) {
+      pair->distance |= MAP_MOVED;
+      m->old_count--;
     }
-
-    free(pair->value);
-    free(pair);
   }
 }
 
 void xdwl_map_remove_str(xdwl_map *m, const char *key_str) {
-  size_t key = hash_string(key_str);
-  return xdwl_map_remove(m, key);
+  const char *key = xdwl_intern_lookup(key_str);
+  if (key)
+    xdwl_map_remove(m, (size_t)key);
 }
 
 void *xdwl_map_get(xdwl_map *m, size_t key) {
-  size_t n = key % m->size;
-  struct xdwl_map_pair *pair = m->pairs[n];
+  if (!m->slots)
+    return NULL;
+
+  struct xdwl_map_pair *pair =
+      map_find(m->slots, m->size, m->stride, m->shift, key);
 
-  for (; pair && pair->key != key; pair = pair->next)
-    ;
+  if (!pair && m->old_slots)
+    pair = map_find(m->old_slots, m->old_size, m->stride, m->old_shift, key);
 
   if (pair)
     return pair->value;
@@ -132,8 +342,190 @@ void *xdwl_map_get(xdwl_map *m, size_t key) {
 };
 
 void *xdwl_map_get_str(xdwl_map *m, const char *key_str) {
-  size_t key = hash_string(key_str);
-  return xdwl_map_get(m, key);
+  // a string that was never interned can't be a key of any map
+  const char *key = xdwl_intern_lookup(key_str);
+  if (!key)
+    return NULL;
+
+  return xdwl_map_get(m, (size_t)key);
+}
+
+struct xdwl_interned {
+  struct xdwl_interned *next; // same hash, different string
+  size_t hash;
+  char string[];
+};
+
+#define interned_of(s)                                                         \
+  ((struct xdwl_interned *)((s) - offsetof(struct xdwl_interned, string)))
+
+// shared by every proxy and thread. lookups only read the map, an insert
+// can rehash and free its slots
+static xdwl_map *__interned = NULL;
+static pthread_rwlock_t intern_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static const char *intern_find(const char *string, size_t hash) {
+  struct xdwl_interned **head;
+
+  if (!__interned || !(head = xdwl_map_get(__interned, hash)))
+    return NULL;
+
+  for (struct xdwl_interned *i = *head; i; i = i->next) {
+    if (strcmp(i->string, string) == 0)
+      return i->string;
+  }
+
+  return NULL;
+}
+
+static const char *intern_insert(const char *string, size_t hash) {
+  // another thread may have inserted it between the two locks
+  const char *found = intern_find(string, hash);
+  if (found)
+    return found;
+
+  if (!__interned && !(__interned = xdwl_map_new(64)))
+    return NULL;
+
+  size_t length = strlen(string);
+  struct xdwl_interned *interned =
+      malloc(sizeof(struct xdwl_interned) + length + 1);
+  if (!interned) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_intern: failed to malloc() string");
+    return NULL;
+  }
+
+  interned->hash = hash;
+  memcpy(interned->string, string, length + 1);
+
+  struct xdwl_interned **head =
+      xdwl_map_get_or_insert(__interned, hash, sizeof(*head), NULL);
+  if (!head) {
+    free(interned);
+    return NULL;
+  }
+
+  interned->next = *head;
+  *head = interned;
+
+  return interned->string;
+}
+
+const char *xdwl_intern(const char *string) {
+  size_t hash = hash_string(string);
+
+  pthread_rwlock_rdlock(&intern_lock);
+  const char *found = intern_find(string, hash);
+  pthread_rwlock_unlock(&intern_lock);
+  if (found)
+    return found;
+
+  pthread_rwlock_wrlock(&intern_lock);
+  found = intern_insert(string, hash);
+  pthread_rwlock_unlock(&intern_lock);
+
+  return found;
+}
+
+const char *xdwl_intern_lookup(const char *string) {
+  size_t hash = hash_string(string);
+
+  pthread_rwlock_rdlock(&intern_lock);
+  const char *found = intern_find(string, hash);
+  pthread_rwlock_unlock(&intern_lock);
+
+  return found;
+}
+
+size_t xdwl_intern_hash(const char *interned) {
+  return interned_of(interned)->hash;
+}
+
+__attribute__((destructor)) static void intern_destroy() {
+  struct xdwl_map_pair *pair;
+
+  pthread_rwlock_wrlock(&intern_lock);
+  if (!__interned) {
+    pthread_rwlock_unlock(&intern_lock);
+    return;
+  }
+
+  xdwl_map_for_each(__interned, pair) {
+    struct xdwl_interned *i = *(struct xdwl_interned **)pair->value;
+    while (i) {
+      struct xdwl_interned *next = i->next;
+      free(i);
+      i = next;
+    }
+  }
+
+  xdwl_map_destroy(__interned);
+  __interned = NULL;
+  pthread_rwlock_unlock(&intern_lock);
+}
+
+void xdwl_ilist_init(xdwl_ilist *l) {
+  l->head.prev = NULL;
+  l->head.next = &l->tail;
+  l->tail.prev = &l->head;
+  l->tail.next = NULL;
+  l->length = 0;
+}
+
+static void ilist_insert_after(struct xdwl_link *pos, struct xdwl_link *link) {
+  link->prev = pos;
+  link->next = pos->next;
+  pos->next->prev = link;
+  pos->next = link;
+}
+
+void xdwl_ilist_push(xdwl_ilist *l, struct xdwl_link *link) {
+  ilist_insert_after(l->tail.prev, link);
+  l->length++;
+}
+
+void xdwl_ilist_push_front(xdwl_ilist *l, struct xdwl_link *link) {
+  ilist_insert_after(&l->head, link);
+  l->length++;
+}
+
+void xdwl_ilist_insert_after(xdwl_ilist *l, struct xdwl_link *pos,
+                             struct xdwl_link *link) {
+  ilist_insert_after(pos, link);
+  l->length++;
+}
+
+void xdwl_ilist_remove(xdwl_ilist *l, struct xdwl_link *link) {
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link->prev = NULL;
+  link->next = NULL;
+  l->length--;
+}
+
+void xdwl_ilist_splice(xdwl_ilist *dst, xdwl_ilist *src) {
+  if (src->length == 0)
+    return;
+
+  struct xdwl_link *first = src->head.next;
+  struct xdwl_link *last = src->tail.prev;
+
+  first->prev = dst->tail.prev;
+  dst->tail.prev->next = first;
+  last->next = &dst->tail;
+  dst->tail.prev = last;
+  dst->length += src->length;
+
+  xdwl_ilist_init(src);
+}
+
+struct xdwl_link *xdwl_ilist_first(xdwl_ilist *l) {
+  return l->length ? l->head.next : NULL;
+}
+
+struct xdwl_link *xdwl_ilist_last(xdwl_ilist *l) {
+  return l->length ? l->tail.prev : NULL;
 }
 
 xdwl_list *xdwl_list_new() {
@@ -144,99 +536,185 @@ xdwl_list *xdwl_list_new() {
     return NULL;
   }
 
-  l->data = NULL;
-  l->next = NULL;
-  l->prev = NULL;
-
+  xdwl_ilist_init(&l->items);
   return l;
 }
 
 void xdwl_list_destroy(xdwl_list *l) {
-  while (l) {
-    xdwl_list *next = l->next;
-    free(l->data);
-    free(l);
-    l = next;
+  struct xdwl_link *link, *tmp;
+
+  if (!l)
+    return;
+
+  xdwl_ilist_for_each_safe(link, tmp, &l->items) {
+    free(xdwl_container_of(link, struct xdwl_list_node, link));
   }
+
+  free(l);
 }
 
 void *xdwl_list_push(xdwl_list *l, void *data, size_t data_size) {
-  for (; l->next; l = l->next)
-    ;
-
-  l->next = xdwl_list_new();
-  l->next->prev = l;
-
-  l->data = malloc(data_size);
-  if (!l->data) {
+  // node and data share one allocation
+  struct xdwl_list_node *node =
+      malloc(sizeof(struct xdwl_list_node) + data_size);
+  if (!node) {
     perror("malloc");
     xdwl_error_set(XDWLERR_STD, "xdwl_list_push: failed to malloc() data");
     return NULL;
   }
-  memcpy(l->data, data, data_size);
 
-  return l->data;
+  memcpy(node->data, data, data_size);
+  xdwl_ilist_push(&l->items, &node->link);
+
+  return node->data;
 }
 
-void xdwl_list_remove(xdwl_list **head, size_t n) {
-  size_t i;
-  xdwl_list *l = *head;
-
-  for (i = 0; l; l = l->next, i++) {
-    if (n == i) {
-      if (l->prev) {
-        l->prev->next = l->next;
-      } else {
-        *head = l->next;
-      }
+static struct xdwl_list_node *list_nth(xdwl_list *l, size_t n) {
+  struct xdwl_link *link;
+  size_t i = 0;
 
-      if (l->next)
-        l->next->prev = l->prev;
+  if (n >= l->items.length)
+    return NULL;
 
-      free(l->data);
-      free(l);
-      break;
-    }
+  xdwl_ilist_for_each(link, &l->items) {
+    if (i++ == n)
+      return xdwl_container_of(link, struct xdwl_list_node, link);
   }
+
+  return NULL;
 }
 
-void *xdwl_list_get(xdwl_list *l, size_t n) {
-  size_t i;
-  for (i = 0; l->next; l = l->next, i++) {
-    if (n == i) {
-      return l->data;
-    }
+void xdwl_list_remove(xdwl_list **head, size_t n) {
+  struct xdwl_list_node *node = list_nth(*head, n);
+
+  if (node) {
+    xdwl_ilist_remove(&(*head)->items, &node->link);
+    free(node);
   }
+}
+
+void *xdwl_list_get(xdwl_list *l, size_t n) {
+  struct xdwl_list_node *node = list_nth(l, n);
+  if (node)
+    return node->data;
 
   xdwl_error_set(XDWLERR_OUTOFRANGE, "xdwl_list_get: %ld is out of range", n);
   return NULL;
 }
 
 size_t xdwl_list_len(xdwl_list *l) {
-  size_t i;
   if (!l)
     return 0;
 
-  for (i = 0; l->next; l = l->next, i++)
-    ;
-  return i;
+  return l->items.length;
+}
+
+static size_t pool_slab_size(xdwl_pool *p) {
+  return sizeof(struct xdwl_pool_slab) + p->item_size * p->items_per_slab;
+}
+
+xdwl_pool *xdwl_pool_new(size_t item_size, size_t items_per_slab) {
+  return xdwl_pool_new_in(item_size, items_per_slab, NULL);
+}
+
+xdwl_pool *xdwl_pool_new_in(size_t item_size, size_t items_per_slab,
+                            struct xdwl_alloc_account *account) {
+  xdwl_pool *p = xdwl_alloc(account, sizeof(xdwl_pool));
+  if (p == NULL) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_pool_new: failed to malloc()");
+    return NULL;
+  }
+
+  // freed items hold the free list link, so they must fit a pointer
+  if (item_size < sizeof(void *))
+    item_size = sizeof(void *);
+
+  p->item_size = (item_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  p->items_per_slab = items_per_slab ? items_per_slab : 1;
+  p->slabs = NULL;
+  p->free_items = NULL;
+  p->account = account;
+
+  return p;
+}
+
+void xdwl_pool_destroy(xdwl_pool *p) {
+  if (!p)
+    return;
+
+  struct xdwl_pool_slab *slab = p->slabs;
+  while (slab) {
+    struct xdwl_pool_slab *next = slab->next;
+    xdwl_free(p->account, slab, pool_slab_size(p));
+    slab = next;
+  }
+
+  xdwl_free(p->account, p, sizeof(xdwl_pool));
+}
+
+static int xdwl_pool_grow(xdwl_pool *p) {
+  struct xdwl_pool_slab *slab = xdwl_alloc(p->account, pool_slab_size(p));
+  if (!slab) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_pool_alloc: failed to malloc() slab");
+    return -1;
+  }
+
+  slab->next = p->slabs;
+  p->slabs = slab;
+
+  // thread the new items onto the free list, first item ends up on top
+  char *items = (char *)(slab + 1);
+  for (size_t i = p->items_per_slab; i > 0; i--) {
+    void **item = (void **)(items + (i - 1) * p->item_size);
+    *item = p->free_items;
+    p->free_items = item;
+  }
+
+  return 0;
+}
+
+void *xdwl_pool_alloc(xdwl_pool *p) {
+  if (!p->free_items && xdwl_pool_grow(p) == -1)
+    return NULL;
+
+  void **item = p->free_items;
+  p->free_items = *item;
+
+  return item;
+}
+
+void xdwl_pool_free(xdwl_pool *p, void *item) {
+  if (!item)
+    return;
+
+  *(void **)item = p->free_items;
+  p->free_items = item;
+}
+
+xdwl_bitmap *xdwl_bitmap_new(uint32_t size) {
+  return xdwl_bitmap_new_in(size, NULL);
 }
 
-xdwl_bitmap *xdwl_bitmap_new(size_t size) {
-  xdwl_bitmap *bm = malloc(sizeof(xdwl_bitmap));
+xdwl_bitmap *xdwl_bitmap_new_in(uint32_t size,
+                                struct xdwl_alloc_account *account) {
+  xdwl_bitmap *bm = xdwl_alloc(account, sizeof(xdwl_bitmap));
   if (bm == NULL) {
     perror("malloc");
     xdwl_error_set(XDWLERR_STD, "xdwl_bitmap_new: failed to malloc()");
     return NULL;
   }
 
-  bm->bytes = calloc(1, size / 8);
+  bm->bytes = xdwl_alloc_zeroed(account, size / 8);
   if (!bm->bytes) {
     perror("calloc");
     xdwl_error_set(XDWLERR_STD, "xdwl_bitmap_new: failed to calloc()");
+    xdwl_free(account, bm, sizeof(xdwl_bitmap));
     return NULL;
   }
   bm->size = size;
+  bm->account = account;
 
   return bm;
 }
@@ -245,8 +723,8 @@ void xdwl_bitmap_destroy(xdwl_bitmap *bm) {
   if (!bm)
     return;
 
-  free(bm->bytes);
-  free(bm);
+  xdwl_free(bm->account, bm->bytes, bm->size / 8);
+  xdwl_free(bm->account, bm, sizeof(xdwl_bitmap));
 }
 
 int xdwl_bitmap_set(xdwl_bitmap *bm, uint32_t n) {
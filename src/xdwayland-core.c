@@ -16,8 +16,8 @@ int xdwl_display_get_registry(xdwl_proxy *proxy, xdwl_id _registry) {
 };
 
 static const struct xdwl_method xdwl_display_requests[] = {
-    {"sync", 1, "u"},
-    {"get_registry", 1, "u"},
+    {"sync", 1, "u", "wl_callback", 0},
+    {"get_registry", 1, "u", "wl_registry", 0},
 };
 static const struct xdwl_method xdwl_display_events[] = {
     {"error", 3, "uus"},
@@ -26,7 +26,9 @@ static const struct xdwl_method xdwl_display_events[] = {
 const struct xdwl_interface xdwl_display_interface = {
     .name = "wl_display",
     .requests = xdwl_display_requests,
+    .request_count = 2,
     .events = xdwl_display_events,
+    .event_count = 2,
 };
 struct xdwl_registry_event_handlers;
 int xdwl_registry_add_listener(
@@ -53,7 +55,9 @@ static const struct xdwl_method xdwl_registry_events[] = {
 const struct xdwl_interface xdwl_registry_interface = {
     .name = "wl_registry",
     .requests = xdwl_registry_requests,
+    .request_count = 1,
     .events = xdwl_registry_events,
+    .event_count = 2,
 };
 struct xdwl_callback_event_handlers;
 int xdwl_callback_add_listener(
@@ -69,6 +73,7 @@ static const struct xdwl_method xdwl_callback_events[] = {
 const struct xdwl_interface xdwl_callback_interface = {
     .name = "wl_callback",
     .events = xdwl_callback_events,
+    .event_count = 1,
 };
 int xdwl_compositor_create_surface(xdwl_proxy *proxy, xdwl_id wl_compositor_id,
                                    xdwl_id _id) {
@@ -80,12 +85,13 @@ int xdwl_compositor_create_region(xdwl_proxy *proxy, xdwl_id wl_compositor_id,
 };
 
 static const struct xdwl_method xdwl_compositor_requests[] = {
-    {"create_surface", 1, "u"},
-    {"create_region", 1, "u"},
+    {"create_surface", 1, "u", "wl_surface", 0},
+    {"create_region", 1, "u", "wl_region", 0},
 };
 const struct xdwl_interface xdwl_compositor_interface = {
     .name = "wl_compositor",
     .requests = xdwl_compositor_requests,
+    .request_count = 2,
 };
 int xdwl_shm_pool_create_buffer(xdwl_proxy *proxy, xdwl_id wl_shm_pool_id,
                                 xdwl_id _id, int32_t _offset, int32_t _width,
@@ -103,13 +109,14 @@ int xdwl_shm_pool_resize(xdwl_proxy *proxy, xdwl_id wl_shm_pool_id,
 };
 
 static const struct xdwl_method xdwl_shm_pool_requests[] = {
-    {"create_buffer", 6, "uiiiiu"},
+    {"create_buffer", 6, "uiiiiu", "wl_buffer", 0},
     {"destroy", 0, NULL},
     {"resize", 1, "i"},
 };
 const struct xdwl_interface xdwl_shm_pool_interface = {
     .name = "wl_shm_pool",
     .requests = xdwl_shm_pool_requests,
+    .request_count = 3,
 };
 struct xdwl_shm_event_handlers;
 int xdwl_shm_add_listener(xdwl_proxy *proxy,
@@ -128,7 +135,7 @@ int xdwl_shm_release(xdwl_proxy *proxy, xdwl_id wl_shm_id) {
 };
 
 static const struct xdwl_method xdwl_shm_requests[] = {
-    {"create_pool", 3, "uhi"},
+    {"create_pool", 3, "uhi", "wl_shm_pool", 0},
     {"release", 0, NULL},
 };
 static const struct xdwl_method xdwl_shm_events[] = {
@@ -137,7 +144,9 @@ static const struct xdwl_method xdwl_shm_events[] = {
 const struct xdwl_interface xdwl_shm_interface = {
     .name = "wl_shm",
     .requests = xdwl_shm_requests,
+    .request_count = 2,
     .events = xdwl_shm_events,
+    .event_count = 1,
 };
 struct xdwl_buffer_event_handlers;
 int xdwl_buffer_add_listener(xdwl_proxy *proxy,
@@ -160,7 +169,9 @@ static const struct xdwl_method xdwl_buffer_events[] = {
 const struct xdwl_interface xdwl_buffer_interface = {
     .name = "wl_buffer",
     .requests = xdwl_buffer_requests,
+    .request_count = 1,
     .events = xdwl_buffer_events,
+    .event_count = 1,
 };
 struct xdwl_data_offer_event_handlers;
 int xdwl_data_offer_add_listener(
@@ -205,7 +216,9 @@ static const struct xdwl_method xdwl_data_offer_events[] = {
 const struct xdwl_interface xdwl_data_offer_interface = {
     .name = "wl_data_offer",
     .requests = xdwl_data_offer_requests,
+    .request_count = 5,
     .events = xdwl_data_offer_events,
+    .event_count = 3,
 };
 struct xdwl_data_source_event_handlers;
 int xdwl_data_source_add_listener(
@@ -242,7 +255,9 @@ static const struct xdwl_method xdwl_data_source_events[] = {
 const struct xdwl_interface xdwl_data_source_interface = {
     .name = "wl_data_source",
     .requests = xdwl_data_source_requests,
+    .request_count = 3,
     .events = xdwl_data_source_events,
+    .event_count = 6,
 };
 struct xdwl_data_device_event_handlers;
 int xdwl_data_device_add_listener(
@@ -273,13 +288,19 @@ static const struct xdwl_method xdwl_data_device_requests[] = {
     {"release", 0, NULL},
 };
 static const struct xdwl_method xdwl_data_device_events[] = {
-    {"data_offer", 1, "u"}, {"enter", 5, "uuffu"}, {"leave", 0, NULL},
-    {"motion", 3, "uff"},   {"drop", 0, NULL},     {"selection", 1, "u"},
+    {"data_offer", 1, "u", "wl_data_offer", 0},
+    {"enter", 5, "uuffu"},
+    {"leave", 0, NULL},
+    {"motion", 3, "uff"},
+    {"drop", 0, NULL},
+    {"selection", 1, "u"},
 };
 const struct xdwl_interface xdwl_data_device_interface = {
     .name = "wl_data_device",
     .requests = xdwl_data_device_requests,
+    .request_count = 3,
     .events = xdwl_data_device_events,
+    .event_count = 6,
 };
 int xdwl_data_device_manager_create_data_source(
     xdwl_proxy *proxy, xdwl_id wl_data_device_manager_id, xdwl_id _id) {
@@ -294,12 +315,13 @@ int xdwl_data_device_manager_get_data_device(xdwl_proxy *proxy,
 };
 
 static const struct xdwl_method xdwl_data_device_manager_requests[] = {
-    {"create_data_source", 1, "u"},
-    {"get_data_device", 2, "uu"},
+    {"create_data_source", 1, "u", "wl_data_source", 0},
+    {"get_data_device", 2, "uu", "wl_data_device", 0},
 };
 const struct xdwl_interface xdwl_data_device_manager_interface = {
     .name = "wl_data_device_manager",
     .requests = xdwl_data_device_manager_requests,
+    .request_count = 2,
 };
 int xdwl_shell_get_shell_surface(xdwl_proxy *proxy, xdwl_id wl_shell_id,
                                  xdwl_id _id, xdwl_id _surface) {
@@ -307,11 +329,12 @@ int xdwl_shell_get_shell_surface(xdwl_proxy *proxy, xdwl_id wl_shell_id,
 };
 
 static const struct xdwl_method xdwl_shell_requests[] = {
-    {"get_shell_surface", 2, "uu"},
+    {"get_shell_surface", 2, "uu", "wl_shell_surface", 0},
 };
 const struct xdwl_interface xdwl_shell_interface = {
     .name = "wl_shell",
     .requests = xdwl_shell_requests,
+    .request_count = 1,
 };
 struct xdwl_shell_surface_event_handlers;
 int xdwl_shell_surface_add_listener(
@@ -399,7 +422,9 @@ static const struct xdwl_method xdwl_shell_surface_events[] = {
 const struct xdwl_interface xdwl_shell_surface_interface = {
     .name = "wl_shell_surface",
     .requests = xdwl_shell_surface_requests,
+    .request_count = 10,
     .events = xdwl_shell_surface_events,
+    .event_count = 3,
 };
 struct xdwl_surface_event_handlers;
 int xdwl_surface_add_listener(
@@ -459,7 +484,7 @@ int xdwl_surface_offset(xdwl_proxy *proxy, xdwl_id wl_surface_id, int32_t _x,
 
 static const struct xdwl_method xdwl_surface_requests[] = {
     {"destroy", 0, NULL},          {"attach", 3, "uii"},
-    {"damage", 4, "iiii"},         {"frame", 1, "u"},
+    {"damage", 4, "iiii"},         {"frame", 1, "u", "wl_callback", 0},
     {"set_opaque_region", 1, "u"}, {"set_input_region", 1, "u"},
     {"commit", 0, NULL},           {"set_buffer_transform", 1, "i"},
     {"set_buffer_scale", 1, "i"},  {"damage_buffer", 4, "iiii"},
@@ -474,7 +499,9 @@ static const struct xdwl_method xdwl_surface_events[] = {
 const struct xdwl_interface xdwl_surface_interface = {
     .name = "wl_surface",
     .requests = xdwl_surface_requests,
+    .request_count = 11,
     .events = xdwl_surface_events,
+    .event_count = 4,
 };
 struct xdwl_seat_event_handlers;
 int xdwl_seat_add_listener(xdwl_proxy *proxy,
@@ -498,9 +525,9 @@ int xdwl_seat_release(xdwl_proxy *proxy, xdwl_id wl_seat_id) {
 };
 
 static const struct xdwl_method xdwl_seat_requests[] = {
-    {"get_pointer", 1, "u"},
-    {"get_keyboard", 1, "u"},
-    {"get_touch", 1, "u"},
+    {"get_pointer", 1, "u", "wl_pointer", 0},
+    {"get_keyboard", 1, "u", "wl_keyboard", 0},
+    {"get_touch", 1, "u", "wl_touch", 0},
     {"release", 0, NULL},
 };
 static const struct xdwl_method xdwl_seat_events[] = {
@@ -510,7 +537,9 @@ static const struct xdwl_method xdwl_seat_events[] = {
 const struct xdwl_interface xdwl_seat_interface = {
     .name = "wl_seat",
     .requests = xdwl_seat_requests,
+    .request_count = 4,
     .events = xdwl_seat_events,
+    .event_count = 2,
 };
 struct xdwl_pointer_event_handlers;
 int xdwl_pointer_add_listener(
@@ -550,7 +579,9 @@ static const struct xdwl_method xdwl_pointer_events[] = {
 const struct xdwl_interface xdwl_pointer_interface = {
     .name = "wl_pointer",
     .requests = xdwl_pointer_requests,
+    .request_count = 2,
     .events = xdwl_pointer_events,
+    .event_count = 11,
 };
 struct xdwl_keyboard_event_handlers;
 int xdwl_keyboard_add_listener(
@@ -574,7 +605,9 @@ static const struct xdwl_method xdwl_keyboard_events[] = {
 const struct xdwl_interface xdwl_keyboard_interface = {
     .name = "wl_keyboard",
     .requests = xdwl_keyboard_requests,
+    .request_count = 1,
     .events = xdwl_keyboard_events,
+    .event_count = 6,
 };
 struct xdwl_touch_event_handlers;
 int xdwl_touch_add_listener(xdwl_proxy *proxy,
@@ -599,7 +632,9 @@ static const struct xdwl_method xdwl_touch_events[] = {
 const struct xdwl_interface xdwl_touch_interface = {
     .name = "wl_touch",
     .requests = xdwl_touch_requests,
+    .request_count = 1,
     .events = xdwl_touch_events,
+    .event_count = 7,
 };
 struct xdwl_output_event_handlers;
 int xdwl_output_add_listener(xdwl_proxy *proxy,
@@ -623,7 +658,9 @@ static const struct xdwl_method xdwl_output_events[] = {
 const struct xdwl_interface xdwl_output_interface = {
     .name = "wl_output",
     .requests = xdwl_output_requests,
+    .request_count = 1,
     .events = xdwl_output_events,
+    .event_count = 6,
 };
 int xdwl_region_destroy(xdwl_proxy *proxy, xdwl_id wl_region_id) {
   return xdwl_send_request(proxy, wl_region_id, "wl_region", 0, 0);
@@ -647,6 +684,7 @@ static const struct xdwl_method xdwl_region_requests[] = {
 const struct xdwl_interface xdwl_region_interface = {
     .name = "wl_region",
     .requests = xdwl_region_requests,
+    .request_count = 3,
 };
 int xdwl_subcompositor_destroy(xdwl_proxy *proxy, xdwl_id wl_subcompositor_id) {
   return xdwl_send_request(proxy, wl_subcompositor_id, "wl_subcompositor", 0,
@@ -661,11 +699,12 @@ int xdwl_subcompositor_get_subsurface(xdwl_proxy *proxy,
 
 static const struct xdwl_method xdwl_subcompositor_requests[] = {
     {"destroy", 0, NULL},
-    {"get_subsurface", 3, "uuu"},
+    {"get_subsurface", 3, "uuu", "wl_subsurface", 0},
 };
 const struct xdwl_interface xdwl_subcompositor_interface = {
     .name = "wl_subcompositor",
     .requests = xdwl_subcompositor_requests,
+    .request_count = 2,
 };
 int xdwl_subsurface_destroy(xdwl_proxy *proxy, xdwl_id wl_subsurface_id) {
   return xdwl_send_request(proxy, wl_subsurface_id, "wl_subsurface", 0, 0);
@@ -699,6 +738,7 @@ static const struct xdwl_method xdwl_subsurface_requests[] = {
 const struct xdwl_interface xdwl_subsurface_interface = {
     .name = "wl_subsurface",
     .requests = xdwl_subsurface_requests,
+    .request_count = 6,
 };
 int xdwl_fixes_destroy(xdwl_proxy *proxy, xdwl_id wl_fixes_id) {
   return xdwl_send_request(proxy, wl_fixes_id, "wl_fixes", 0, 0);
@@ -715,6 +755,7 @@ static const struct xdwl_method xdwl_fixes_requests[] = {
 const struct xdwl_interface xdwl_fixes_interface = {
     .name = "wl_fixes",
     .requests = xdwl_fixes_requests,
+    .request_count = 2,
 };
 
 __attribute__((constructor)) static void add_interfaces() {
@@ -0,0 +1,107 @@
+#include "xdwayland-damage.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+// overlapping, or sharing part of an edge. corners alone don't count, the
+// bounding box of two diagonal neighbours is mostly undamaged space
+static int rect_meets(const struct xdwl_rect *a, const struct xdwl_rect *b) {
+  int x_overlap = a->x < b->x + b->width && b->x < a->x + a->width;
+  int y_overlap = a->y < b->y + b->height && b->y < a->y + a->height;
+  int x_touch = a->x <= b->x + b->width && b->x <= a->x + a->width;
+  int y_touch = a->y <= b->y + b->height && b->y <= a->y + a->height;
+
+  return (x_overlap && y_touch) || (y_overlap && x_touch);
+}
+
+static struct xdwl_rect rect_union(const struct xdwl_rect *a,
+                                   const struct xdwl_rect *b) {
+  int32_t x1 = a->x < b->x ? a->x : b->x;
+  int32_t y1 = a->y < b->y ? a->y : b->y;
+  int32_t x2 = a->x + a->width > b->x + b->width ? a->x + a->width
+                                                 : b->x + b->width;
+  int32_t y2 = a->y + a->height > b->y + b->height ? a->y + a->height
+                                                   : b->y + b->height;
+
+  struct xdwl_rect r = {x1, y1, x2 - x1, y2 - y1};
+  return r;
+}
+
+void xdwl_damage_init(struct xdwl_damage *damage, size_t max_rects) {
+  if (max_rects == 0 || max_rects > XDWL_DAMAGE_MAX_RECTS)
+    max_rects = XDWL_DAMAGE_MAX_RECTS;
+
+  damage->count = 0;
+  damage->max_rects = max_rects;
+}
+
+void xdwl_damage_clear(struct xdwl_damage *damage) { damage->count = 0; }
+
+void xdwl_damage_add(struct xdwl_damage *damage, int32_t x, int32_t y,
+                     int32_t width, int32_t height) {
+  struct xdwl_rect r = {x, y, width, height};
+  size_t i = 0;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  // a merged rect may now reach rects it didn't before, so start over
+  while (i < damage->count) {
+    if (rect_meets(&damage->rects[i], &r)) {
+      r = rect_union(&damage->rects[i], &r);
+      damage->rects[i] = damage->rects[--damage->count];
+      i = 0;
+      continue;
+    }
+    i++;
+  }
+
+  if (damage->count == damage->max_rects) {
+    struct xdwl_rect extents = xdwl_damage_extents(damage);
+    r = rect_union(&extents, &r);
+    damage->count = 0;
+  }
+
+  damage->rects[damage->count++] = r;
+}
+
+void xdwl_damage_add_damage(struct xdwl_damage *damage,
+                            const struct xdwl_damage *other) {
+  for (size_t i = 0; i < other->count; i++) {
+    const struct xdwl_rect *r = &other->rects[i];
+    xdwl_damage_add(damage, r->x, r->y, r->width, r->height);
+  }
+}
+
+struct xdwl_rect xdwl_damage_extents(const struct xdwl_damage *damage) {
+  struct xdwl_rect extents = {0, 0, 0, 0};
+
+  if (damage->count == 0)
+    return extents;
+
+  extents = damage->rects[0];
+  for (size_t i = 1; i < damage->count; i++)
+    extents = rect_union(&extents, &damage->rects[i]);
+
+  return extents;
+}
+
+int xdwl_damage_flush(xdwl_proxy *proxy, xdwl_id wl_surface_id,
+                      struct xdwl_damage *damage) {
+  for (size_t i = 0; i < damage->count; i++) {
+    struct xdwl_rect *r = &damage->rects[i];
+    if (xdwl_surface_damage_buffer(proxy, wl_surface_id, r->x, r->y, r->width,
+                                   r->height) == -1)
+      return -1;
+  }
+
+  damage->count = 0;
+  return 0;
+}
+
+int xdwl_damage_commit(xdwl_proxy *proxy, xdwl_id wl_surface_id,
+                       struct xdwl_damage *damage) {
+  if (xdwl_damage_flush(proxy, wl_surface_id, damage) == -1)
+    return -1;
+
+  return xdwl_surface_commit(proxy, wl_surface_id);
+}
@@ -0,0 +1,173 @@
+#include "xdwayland-frame.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t frame_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void frame_histogram_add(struct xdwl_frame_histogram *h,
+                                uint64_t ns) {
+  uint64_t us = ns / 1000;
+  size_t bucket = us ? 63 - __builtin_clzll(us) : 0;
+
+  if (bucket >= XDWL_FRAME_HISTOGRAM_BUCKETS)
+    bucket = XDWL_FRAME_HISTOGRAM_BUCKETS - 1;
+
+  h->buckets[bucket]++;
+  h->count++;
+  h->total_us += us;
+  if (us > h->max_us)
+    h->max_us = us;
+}
+
+static void frame_done(void *user_data, xdwl_arg *args);
+
+// done for a callback whose scheduler was destroyed. the server only lets
+// go of the object with this event, the id can't be reused before it
+static void frame_orphan_done(void *user_data, xdwl_arg *args) {
+  if (xdwl_object_unregister(user_data, args[0].object_id) == -1)
+    xdwl_error_print();
+}
+
+// the frame request rides along with the commit the redraw makes
+static int frame_fire(struct xdwl_frame_scheduler *scheduler, uint32_t time) {
+  struct xdwl_callback_event_handlers handlers = {
+      .done = frame_done,
+  };
+
+  scheduler->callback_id =
+      xdwl_object_register(scheduler->proxy, 0, "wl_callback");
+  if (scheduler->callback_id == 0)
+    return -1;
+
+  if (xdwl_callback_add_listener(scheduler->proxy, &handlers, scheduler) ==
+          -1 ||
+      xdwl_surface_frame(scheduler->proxy, scheduler->surface_id,
+                         scheduler->callback_id) == -1) {
+    if (xdwl_object_unregister(scheduler->proxy, scheduler->callback_id) == -1)
+      xdwl_error_print();
+    scheduler->callback_id = 0;
+    return -1;
+  }
+
+  scheduler->dirty = 0;
+  scheduler->redraw(scheduler->user_data, scheduler, time);
+
+  scheduler->commit_time = frame_now();
+  scheduler->frames++;
+
+  if (time)
+    frame_histogram_add(&scheduler->callback_to_commit,
+                        scheduler->commit_time - scheduler->callback_time);
+
+  return 0;
+}
+
+static void frame_done(void *user_data, xdwl_arg *args) {
+  struct xdwl_frame_scheduler *scheduler = user_data;
+
+  scheduler->callback_time = frame_now();
+  frame_histogram_add(&scheduler->commit_to_callback,
+                      scheduler->callback_time - scheduler->commit_time);
+
+  // the compositor destroys the callback along with done, handing the id
+  // and the object straight back means the next frame reuses both
+  if (xdwl_object_unregister(scheduler->proxy, scheduler->callback_id) == -1)
+    xdwl_error_print();
+  scheduler->callback_id = 0;
+
+  if (!scheduler->dirty) {
+    scheduler->skipped++;
+    return;
+  }
+
+  if (frame_fire(scheduler, args[1].u) == -1)
+    xdwl_error_print();
+}
+
+struct xdwl_frame_scheduler *
+xdwl_frame_scheduler_create(xdwl_proxy *proxy, xdwl_id wl_surface_id,
+                            xdwl_frame_handler *redraw, void *user_data) {
+  if (!redraw) {
+    xdwl_error_set(XDWLERR_NULLARG,
+                   "xdwl_frame_scheduler_create: redraw is NULL");
+    return NULL;
+  }
+
+  struct xdwl_frame_scheduler *scheduler =
+      calloc(1, sizeof(struct xdwl_frame_scheduler));
+  if (!scheduler) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD,
+                   "xdwl_frame_scheduler_create: failed to calloc()");
+    return NULL;
+  }
+
+  scheduler->proxy = proxy;
+  scheduler->surface_id = wl_surface_id;
+  scheduler->redraw = redraw;
+  scheduler->user_data = user_data;
+
+  return scheduler;
+}
+
+void xdwl_frame_scheduler_destroy(struct xdwl_frame_scheduler *scheduler) {
+  if (!scheduler)
+    return;
+
+  // the pending callback stays registered until its done arrives, only
+  // pointing away from the scheduler
+  struct xdwl_callback_event_handlers orphan = {
+      .done = frame_orphan_done,
+  };
+
+  if (scheduler->callback_id &&
+      xdwl_add_listener_by_id(scheduler->proxy, scheduler->callback_id,
+                              &orphan, sizeof(orphan), scheduler->proxy) == -1)
+    xdwl_error_print();
+
+  free(scheduler);
+}
+
+int xdwl_frame_scheduler_schedule(struct xdwl_frame_scheduler *scheduler) {
+  scheduler->dirty = 1;
+
+  if (scheduler->callback_id)
+    return 0;
+
+  return frame_fire(scheduler, 0);
+}
+
+void xdwl_frame_scheduler_reset_stats(struct xdwl_frame_scheduler *scheduler) {
+  scheduler->frames = 0;
+  scheduler->skipped = 0;
+  memset(&scheduler->callback_to_commit, 0,
+         sizeof(struct xdwl_frame_histogram));
+  memset(&scheduler->commit_to_callback, 0,
+         sizeof(struct xdwl_frame_histogram));
+}
+
+uint64_t xdwl_frame_histogram_percentile(const struct xdwl_frame_histogram *h,
+                                         double percentile) {
+  uint64_t seen = 0;
+  uint64_t wanted = h->count * percentile / 100;
+
+  if (h->count == 0)
+    return 0;
+
+  for (size_t i = 0; i < XDWL_FRAME_HISTOGRAM_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen > wanted)
+      return (uint64_t)2 << i;
+  }
+
+  return h->max_us;
+}
@@ -0,0 +1,215 @@
+#include "xdwayland-globals.h"
+#include "xdwayland-client.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GLOBALS_INITIAL_CAPACITY 32
+
+struct globals_fetch {
+  xdwl_proxy *proxy;
+  struct xdwl_globals *globals;
+  size_t capacity;
+  const struct xdwl_global_want *wants;
+  size_t want_count;
+  int failed;
+
+  // what a failed fetch can still take back. a request queued since the
+  // last send never left the process, anything older may have
+  uint64_t send_calls;  // proxy->io.send_calls when last looked at
+  size_t out_length;    // queued bytes that aren't this fetch's
+  int registry_queued;
+  int registry_sent;
+  size_t binds_sent;    // globals before this may have had their bind sent
+};
+
+static void globals_note_sends(struct globals_fetch *fetch) {
+  uint64_t send_calls =
+      __atomic_load_n(&fetch->proxy->io.send_calls, __ATOMIC_RELAXED);
+
+  if (send_calls == fetch->send_calls)
+    return;
+
+  fetch->send_calls = send_calls;
+  fetch->out_length = 0;
+  fetch->registry_sent = fetch->registry_queued;
+  fetch->binds_sent = fetch->globals->count;
+}
+
+static const struct xdwl_global_want *
+globals_wanted(struct globals_fetch *fetch, const char *interface) {
+  for (size_t i = 0; i < fetch->want_count; i++) {
+    if (strcmp(fetch->wants[i].interface, interface) == 0)
+      return &fetch->wants[i];
+  }
+
+  return NULL;
+}
+
+static int globals_bind(struct globals_fetch *fetch,
+                        struct xdwl_global *global) {
+  const struct xdwl_global_want *want =
+      globals_wanted(fetch, global->interface);
+
+  if (!want || xdwl_globals_find(fetch->globals, global->interface) != global)
+    return 0;
+
+  uint32_t version =
+      global->version < want->version ? global->version : want->version;
+
+  global->id = xdwl_object_register(fetch->proxy, 0, global->interface);
+  if (global->id == 0)
+    return -1;
+
+  return xdwl_registry_bind(fetch->proxy, fetch->globals->registry_id,
+                            global->name, global->interface, version,
+                            global->id);
+}
+
+static void globals_on_global(void *data, xdwl_arg *args) {
+  struct globals_fetch *fetch = data;
+  struct xdwl_globals *globals = fetch->globals;
+
+  if (fetch->failed)
+    return;
+
+  globals_note_sends(fetch);
+
+  if (globals->count == fetch->capacity) {
+    size_t capacity = fetch->capacity * 2;
+    struct xdwl_global *grown =
+        realloc(globals->globals, capacity * sizeof(struct xdwl_global));
+    if (!grown) {
+      perror("realloc");
+      xdwl_error_set(XDWLERR_STD, "xdwl_globals_fetch: failed to realloc()");
+      fetch->failed = 1;
+      return;
+    }
+
+    globals->globals = grown;
+    fetch->capacity = capacity;
+  }
+
+  struct xdwl_global *global = &globals->globals[globals->count];
+  global->name = args[1].u;
+  global->interface = xdwl_intern(args[2].s);
+  global->version = args[3].u;
+  global->id = 0;
+
+  if (!global->interface) {
+    fetch->failed = 1;
+    return;
+  }
+  globals->count++;
+
+  // the bind is corked with the rest, it goes out after the sync's done
+  if (globals_bind(fetch, global) == -1)
+    fetch->failed = 1;
+}
+
+// undoes what it can of a failed fetch. requests still queued are dropped
+// and their ids freed. the server holds on to a registry or bound global
+// it has heard of and never says when it's gone, so those stay registered
+// without a listener, the same as an orphaned frame callback
+static void globals_discard(struct globals_fetch *fetch) {
+  xdwl_proxy *proxy = fetch->proxy;
+  struct xdwl_globals *globals = fetch->globals;
+
+  globals_note_sends(fetch);
+  proxy->out_length = fetch->out_length;
+
+  for (size_t i = fetch->binds_sent; i < globals->count; i++) {
+    if (globals->globals[i].id &&
+        xdwl_object_unregister(proxy, globals->globals[i].id) == -1)
+      xdwl_error_print();
+  }
+
+  if (globals->registry_id && !fetch->registry_sent &&
+      xdwl_object_unregister(proxy, globals->registry_id) == -1)
+    xdwl_error_print();
+
+  xdwl_globals_release(globals);
+}
+
+int xdwl_globals_fetch(xdwl_proxy *proxy, const struct xdwl_global_want *wants,
+                       size_t want_count, struct xdwl_globals *globals) {
+  struct globals_fetch fetch = {
+      proxy,
+      globals,
+      GLOBALS_INITIAL_CAPACITY,
+      wants,
+      want_count,
+      0,
+      __atomic_load_n(&proxy->io.send_calls, __ATOMIC_RELAXED),
+      proxy->out_length,
+      0,
+      0,
+      0};
+  struct xdwl_registry_event_handlers handlers = {.global = globals_on_global};
+  struct xdwl_registry_event_handlers none = {0};
+  int corked = proxy->corked;
+
+  globals->count = 0;
+  globals->globals =
+      malloc(GLOBALS_INITIAL_CAPACITY * sizeof(struct xdwl_global));
+  if (!globals->globals) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_globals_fetch: failed to malloc()");
+    return -1;
+  }
+
+  globals->registry_id = xdwl_object_register(proxy, 0, "wl_registry");
+  if (globals->registry_id == 0 ||
+      xdwl_registry_add_listener(proxy, &handlers, &fetch) == -1) {
+    globals_discard(&fetch);
+    return -1;
+  }
+
+  xdwl_proxy_cork(proxy);
+
+  int r = 0;
+  if (xdwl_display_get_registry(proxy, globals->registry_id) == -1) {
+    r = -1;
+  } else {
+    // queueing it may have flushed the caller's requests, not itself
+    globals_note_sends(&fetch);
+    fetch.registry_queued = 1;
+
+    if (xdwl_roundtrip(proxy) == -1 || fetch.failed)
+      r = -1;
+  }
+
+  // the handlers point at this stack frame
+  if (xdwl_registry_add_listener(proxy, &none, NULL) == -1)
+    r = -1;
+
+  if (!corked) {
+    if (r == 0)
+      r = xdwl_proxy_uncork(proxy);
+    proxy->corked = 0;
+  }
+
+  if (r == -1)
+    globals_discard(&fetch);
+
+  return r;
+}
+
+const struct xdwl_global *xdwl_globals_find(const struct xdwl_globals *globals,
+                                            const char *interface) {
+  for (size_t i = 0; i < globals->count; i++) {
+    if (strcmp(globals->globals[i].interface, interface) == 0)
+      return &globals->globals[i];
+  }
+
+  return NULL;
+}
+
+void xdwl_globals_release(struct xdwl_globals *globals) {
+  free(globals->globals);
+  globals->globals = NULL;
+  globals->count = 0;
+}
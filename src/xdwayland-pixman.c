@@ -0,0 +1,555 @@
+#include "xdwayland-pixman.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+struct pixman_kernels {
+  void (*fill)(uint32_t *dst, size_t n, uint32_t color);
+  void (*premultiply)(uint32_t *p, size_t n);
+  void (*over)(uint32_t *dst, const uint32_t *src, size_t n);
+  // swaps the r and b channels, then ors in alpha_mask
+  void (*swap_rb)(uint32_t *dst, const uint32_t *src, size_t n,
+                  uint32_t alpha_mask);
+  void (*set_alpha)(uint32_t *dst, const uint32_t *src, size_t n,
+                    uint32_t alpha_mask);
+};
+
+static inline uint32_t div255(uint32_t t) {
+  t += 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+static void scalar_fill(uint32_t *dst, size_t n, uint32_t color) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = color;
+}
+
+static inline uint32_t scalar_premultiply_pixel(uint32_t p) {
+  uint32_t a = p >> 24;
+  uint32_t r = div255(((p >> 16) & 0xff) * a);
+  uint32_t g = div255(((p >> 8) & 0xff) * a);
+  uint32_t b = div255((p & 0xff) * a);
+
+  return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void scalar_premultiply(uint32_t *p, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    p[i] = scalar_premultiply_pixel(p[i]);
+}
+
+static inline uint32_t scalar_over_pixel(uint32_t d, uint32_t s) {
+  uint32_t inv = 255 - (s >> 24);
+  uint32_t result = 0;
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    uint32_t c = ((s >> shift) & 0xff) + div255(((d >> shift) & 0xff) * inv);
+    result |= (c > 255 ? 255 : c) << shift;
+  }
+
+  return result;
+}
+
+static void scalar_over(uint32_t *dst, const uint32_t *src, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t s = src[i];
+    if (s >> 24 == 0xff)
+      dst[i] = s;
+    else if (s)
+      dst[i] = scalar_over_pixel(dst[i], s);
+  }
+}
+
+static void scalar_swap_rb(uint32_t *dst, const uint32_t *src, size_t n,
+                           uint32_t alpha_mask) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t p = src[i];
+    dst[i] = (p & 0xff00ff00) | ((p << 16) & 0x00ff0000) |
+             ((p >> 16) & 0x000000ff) | alpha_mask;
+  }
+}
+
+static void scalar_set_alpha(uint32_t *dst, const uint32_t *src, size_t n,
+                             uint32_t alpha_mask) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = src[i] | alpha_mask;
+}
+
+static const struct pixman_kernels scalar_kernels = {
+    .fill = scalar_fill,
+    .premultiply = scalar_premultiply,
+    .over = scalar_over,
+    .swap_rb = scalar_swap_rb,
+    .set_alpha = scalar_set_alpha,
+};
+
+#ifdef HAVE_X86
+
+// pixels are unpacked to 16 bit lanes b, g, r, a. rounds like div255
+__attribute__((target("sse2"))) static inline __m128i
+sse2_div255(__m128i t) {
+  t = _mm_add_epi16(t, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2"))) static inline __m128i
+sse2_alpha(__m128i unpacked) {
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(unpacked, 0xff), 0xff);
+}
+
+__attribute__((target("sse2"))) static void sse2_fill(uint32_t *dst, size_t n,
+                                                      uint32_t color) {
+  __m128i c = _mm_set1_epi32(color);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i *)(dst + i), c);
+
+  scalar_fill(dst + i, n - i, color);
+}
+
+__attribute__((target("sse2"))) static void sse2_premultiply(uint32_t *p,
+                                                             size_t n) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  __m128i alpha_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((__m128i *)(p + i));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+    // multiply colors by alpha and alpha by 255, which keeps it as is
+    __m128i alo = _mm_or_si128(_mm_and_si128(sse2_alpha(lo), rgb_mask),
+                               alpha_one);
+    __m128i ahi = _mm_or_si128(_mm_and_si128(sse2_alpha(hi), rgb_mask),
+                               alpha_one);
+
+    lo = sse2_div255(_mm_mullo_epi16(lo, alo));
+    hi = sse2_div255(_mm_mullo_epi16(hi, ahi));
+
+    _mm_storeu_si128((__m128i *)(p + i), _mm_packus_epi16(lo, hi));
+  }
+
+  scalar_premultiply(p + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+sse2_over(uint32_t *dst, const uint32_t *src, size_t n) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+  __m128i ff = _mm_set1_epi16(255);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i s = _mm_loadu_si128((__m128i *)(src + i));
+
+    __m128i opaque =
+        _mm_cmpeq_epi32(_mm_and_si128(s, alpha_mask), alpha_mask);
+    if (_mm_movemask_epi8(opaque) == 0xffff) {
+      _mm_storeu_si128((__m128i *)(dst + i), s);
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff)
+      continue;
+
+    __m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+    __m128i inv_lo =
+        _mm_sub_epi16(ff, sse2_alpha(_mm_unpacklo_epi8(s, zero)));
+    __m128i inv_hi =
+        _mm_sub_epi16(ff, sse2_alpha(_mm_unpackhi_epi8(s, zero)));
+
+    __m128i lo =
+        sse2_div255(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv_lo));
+    __m128i hi =
+        sse2_div255(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv_hi));
+
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+  }
+
+  scalar_over(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+sse2_swap_rb(uint32_t *dst, const uint32_t *src, size_t n,
+             uint32_t alpha_mask) {
+  __m128i ag = _mm_set1_epi32(0xff00ff00);
+  __m128i r = _mm_set1_epi32(0x00ff0000);
+  __m128i b = _mm_set1_epi32(0x000000ff);
+  __m128i a = _mm_set1_epi32(alpha_mask);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i p = _mm_loadu_si128((__m128i *)(src + i));
+    __m128i v = _mm_or_si128(
+        _mm_and_si128(p, ag),
+        _mm_or_si128(_mm_and_si128(_mm_slli_epi32(p, 16), r),
+                     _mm_and_si128(_mm_srli_epi32(p, 16), b)));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(v, a));
+  }
+
+  scalar_swap_rb(dst + i, src + i, n - i, alpha_mask);
+}
+
+__attribute__((target("sse2"))) static void
+sse2_set_alpha(uint32_t *dst, const uint32_t *src, size_t n,
+               uint32_t alpha_mask) {
+  __m128i a = _mm_set1_epi32(alpha_mask);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i p = _mm_loadu_si128((__m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(p, a));
+  }
+
+  scalar_set_alpha(dst + i, src + i, n - i, alpha_mask);
+}
+
+static const struct pixman_kernels sse2_kernels = {
+    .fill = sse2_fill,
+    .premultiply = sse2_premultiply,
+    .over = sse2_over,
+    .swap_rb = sse2_swap_rb,
+    .set_alpha = sse2_set_alpha,
+};
+
+__attribute__((target("avx2"))) static inline __m256i
+avx2_div255(__m256i t) {
+  t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+avx2_alpha(__m256i unpacked) {
+  return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(unpacked, 0xff), 0xff);
+}
+
+__attribute__((target("avx2"))) static void avx2_fill(uint32_t *dst, size_t n,
+                                                      uint32_t color) {
+  __m256i c = _mm256_set1_epi32(color);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i *)(dst + i), c);
+
+  sse2_fill(dst + i, n - i, color);
+}
+
+// unpack and pack work within 128 bit lanes, so pixel order survives the
+// round trip without any cross-lane permutes
+__attribute__((target("avx2"))) static void avx2_premultiply(uint32_t *p,
+                                                             size_t n) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i rgb_mask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1,
+                                      -1, 0, -1, -1, -1);
+  __m256i alpha_one = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0,
+                                       0, 255, 0, 0, 0);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((__m256i *)(p + i));
+    __m256i lo = _mm256_unpacklo_epi8(v, zero);
+    __m256i hi = _mm256_unpackhi_epi8(v, zero);
+
+    __m256i alo = _mm256_or_si256(
+        _mm256_and_si256(avx2_alpha(lo), rgb_mask), alpha_one);
+    __m256i ahi = _mm256_or_si256(
+        _mm256_and_si256(avx2_alpha(hi), rgb_mask), alpha_one);
+
+    lo = avx2_div255(_mm256_mullo_epi16(lo, alo));
+    hi = avx2_div255(_mm256_mullo_epi16(hi, ahi));
+
+    _mm256_storeu_si256((__m256i *)(p + i), _mm256_packus_epi16(lo, hi));
+  }
+
+  sse2_premultiply(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_over(uint32_t *dst, const uint32_t *src, size_t n) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+  __m256i ff = _mm256_set1_epi16(255);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i s = _mm256_loadu_si256((__m256i *)(src + i));
+
+    __m256i opaque =
+        _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha_mask), alpha_mask);
+    if (_mm256_movemask_epi8(opaque) == -1) {
+      _mm256_storeu_si256((__m256i *)(dst + i), s);
+      continue;
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1)
+      continue;
+
+    __m256i d = _mm256_loadu_si256((__m256i *)(dst + i));
+    __m256i inv_lo =
+        _mm256_sub_epi16(ff, avx2_alpha(_mm256_unpacklo_epi8(s, zero)));
+    __m256i inv_hi =
+        _mm256_sub_epi16(ff, avx2_alpha(_mm256_unpackhi_epi8(s, zero)));
+
+    __m256i lo = avx2_div255(
+        _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), inv_lo));
+    __m256i hi = avx2_div255(
+        _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), inv_hi));
+
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s));
+  }
+
+  sse2_over(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_swap_rb(uint32_t *dst, const uint32_t *src, size_t n,
+             uint32_t alpha_mask) {
+  __m256i shuffle =
+      _mm256_set_epi8(15, 12, 13, 14, 11, 8, 9, 10, 7, 4, 5, 6, 3, 0, 1, 2, 15,
+                      12, 13, 14, 11, 8, 9, 10, 7, 4, 5, 6, 3, 0, 1, 2);
+  __m256i a = _mm256_set1_epi32(alpha_mask);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i p = _mm256_loadu_si256((__m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_or_si256(_mm256_shuffle_epi8(p, shuffle), a));
+  }
+
+  sse2_swap_rb(dst + i, src + i, n - i, alpha_mask);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_set_alpha(uint32_t *dst, const uint32_t *src, size_t n,
+               uint32_t alpha_mask) {
+  __m256i a = _mm256_set1_epi32(alpha_mask);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i p = _mm256_loadu_si256((__m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(p, a));
+  }
+
+  sse2_set_alpha(dst + i, src + i, n - i, alpha_mask);
+}
+
+static const struct pixman_kernels avx2_kernels = {
+    .fill = avx2_fill,
+    .premultiply = avx2_premultiply,
+    .over = avx2_over,
+    .swap_rb = avx2_swap_rb,
+    .set_alpha = avx2_set_alpha,
+};
+
+#endif
+
+static const struct pixman_kernels *kernels = &scalar_kernels;
+static enum xdwl_pixman_impl kernels_impl = XDWL_PIXMAN_SCALAR;
+
+static int pixman_impl_supported(enum xdwl_pixman_impl impl) {
+  switch (impl) {
+  case XDWL_PIXMAN_SCALAR:
+    return 1;
+#ifdef HAVE_X86
+  case XDWL_PIXMAN_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case XDWL_PIXMAN_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return 0;
+  }
+}
+
+enum xdwl_pixman_impl xdwl_pixman_get_impl() { return kernels_impl; }
+
+int xdwl_pixman_set_impl(enum xdwl_pixman_impl impl) {
+  if (!pixman_impl_supported(impl)) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_pixman_set_impl: implementation %d isn't supported "
+                   "by this cpu",
+                   impl);
+    return -1;
+  }
+
+  switch (impl) {
+#ifdef HAVE_X86
+  case XDWL_PIXMAN_AVX2:
+    kernels = &avx2_kernels;
+    break;
+  case XDWL_PIXMAN_SSE2:
+    kernels = &sse2_kernels;
+    break;
+#endif
+  default:
+    kernels = &scalar_kernels;
+    break;
+  }
+
+  kernels_impl = impl;
+  return 0;
+}
+
+__attribute__((constructor)) static void pixman_select_impl() {
+#ifdef HAVE_X86
+  __builtin_cpu_init();
+#endif
+
+  for (int impl = XDWL_PIXMAN_AVX2; impl >= XDWL_PIXMAN_SCALAR; impl--) {
+    if (pixman_impl_supported(impl) && xdwl_pixman_set_impl(impl) == 0)
+      break;
+  }
+}
+
+static int format_has_alpha(uint32_t format) {
+  return format == XDWL_SHM_FORMAT_ARGB8888 ||
+         format == XDWL_SHM_FORMAT_ABGR8888;
+}
+
+static int format_is_bgr(uint32_t format) {
+  return format == XDWL_SHM_FORMAT_ABGR8888 ||
+         format == XDWL_SHM_FORMAT_XBGR8888;
+}
+
+static int format_supported(uint32_t format) {
+  return format == XDWL_SHM_FORMAT_ARGB8888 ||
+         format == XDWL_SHM_FORMAT_XRGB8888 ||
+         format == XDWL_SHM_FORMAT_ABGR8888 ||
+         format == XDWL_SHM_FORMAT_XBGR8888;
+}
+
+static int clip_rect(const struct xdwl_image *image, struct xdwl_rect *rect) {
+  int32_t x1 = rect->x < 0 ? 0 : rect->x;
+  int32_t y1 = rect->y < 0 ? 0 : rect->y;
+  int32_t x2 = rect->x + rect->width;
+  int32_t y2 = rect->y + rect->height;
+
+  if (x2 > image->width)
+    x2 = image->width;
+  if (y2 > image->height)
+    y2 = image->height;
+
+  rect->x = x1;
+  rect->y = y1;
+  rect->width = x2 - x1;
+  rect->height = y2 - y1;
+
+  return rect->width > 0 && rect->height > 0;
+}
+
+// clips rect against src and the dst area it maps to, moving dst_x/dst_y
+// along with the rect origin
+static int clip_blit(const struct xdwl_image *dst, int32_t *dst_x,
+                     int32_t *dst_y, const struct xdwl_image *src,
+                     struct xdwl_rect *rect) {
+  struct xdwl_rect r = *rect;
+  struct xdwl_rect d;
+
+  if (!clip_rect(src, &r))
+    return 0;
+
+  d.x = *dst_x + (r.x - rect->x);
+  d.y = *dst_y + (r.y - rect->y);
+  d.width = r.width;
+  d.height = r.height;
+
+  struct xdwl_rect clipped = d;
+  if (!clip_rect(dst, &clipped))
+    return 0;
+
+  r.x += clipped.x - d.x;
+  r.y += clipped.y - d.y;
+  r.width = clipped.width;
+  r.height = clipped.height;
+
+  *rect = r;
+  *dst_x = clipped.x;
+  *dst_y = clipped.y;
+  return 1;
+}
+
+static inline uint32_t *image_row(const struct xdwl_image *image, int32_t x,
+                                  int32_t y) {
+  return (uint32_t *)((char *)image->data + (size_t)y * image->stride) + x;
+}
+
+void xdwl_pixman_fill(struct xdwl_image *image, struct xdwl_rect rect,
+                      uint32_t color) {
+  if (!clip_rect(image, &rect))
+    return;
+
+  for (int32_t y = rect.y; y < rect.y + rect.height; y++)
+    kernels->fill(image_row(image, rect.x, y), rect.width, color);
+}
+
+void xdwl_pixman_premultiply(struct xdwl_image *image, struct xdwl_rect rect) {
+  if (!clip_rect(image, &rect))
+    return;
+
+  for (int32_t y = rect.y; y < rect.y + rect.height; y++)
+    kernels->premultiply(image_row(image, rect.x, y), rect.width);
+}
+
+void xdwl_pixman_copy(struct xdwl_image *dst, int32_t dst_x, int32_t dst_y,
+                      const struct xdwl_image *src, struct xdwl_rect rect) {
+  if (!clip_blit(dst, &dst_x, &dst_y, src, &rect))
+    return;
+
+  // libc's memmove is already vectorized and handles overlapping rows
+  for (int32_t y = 0; y < rect.height; y++)
+    memmove(image_row(dst, dst_x, dst_y + y),
+            image_row(src, rect.x, rect.y + y), rect.width * sizeof(uint32_t));
+}
+
+void xdwl_pixman_over(struct xdwl_image *dst, int32_t dst_x, int32_t dst_y,
+                      const struct xdwl_image *src, struct xdwl_rect rect) {
+  if (!clip_blit(dst, &dst_x, &dst_y, src, &rect))
+    return;
+
+  for (int32_t y = 0; y < rect.height; y++)
+    kernels->over(image_row(dst, dst_x, dst_y + y),
+                  image_row(src, rect.x, rect.y + y), rect.width);
+}
+
+int xdwl_pixman_convert(struct xdwl_image *dst, int32_t dst_x, int32_t dst_y,
+                        const struct xdwl_image *src, struct xdwl_rect rect) {
+  if (!format_supported(dst->format) || !format_supported(src->format)) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_pixman_convert: can't convert format 0x%x to 0x%x",
+                   src->format, dst->format);
+    return -1;
+  }
+
+  if (!clip_blit(dst, &dst_x, &dst_y, src, &rect))
+    return 0;
+
+  // the x byte of a source without alpha is undefined, make it opaque
+  uint32_t alpha_mask =
+      format_has_alpha(dst->format) && !format_has_alpha(src->format)
+          ? 0xff000000
+          : 0;
+  int swap = format_is_bgr(dst->format) != format_is_bgr(src->format);
+
+  for (int32_t y = 0; y < rect.height; y++) {
+    uint32_t *d = image_row(dst, dst_x, dst_y + y);
+    const uint32_t *s = image_row(src, rect.x, rect.y + y);
+
+    if (swap)
+      kernels->swap_rb(d, s, rect.width, alpha_mask);
+    else if (alpha_mask)
+      kernels->set_alpha(d, s, rect.width, alpha_mask);
+    else
+      memmove(d, s, rect.width * sizeof(uint32_t));
+  }
+
+  return 0;
+}
@@ -0,0 +1,173 @@
+#include "xdwayland-region.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define entry_of(l) xdwl_container_of(l, struct xdwl_region_entry, link)
+
+// fnv-1a over the raw rects, order matters like it does for the lookup
+static size_t region_hash(const struct xdwl_rect *rects, size_t count) {
+  const unsigned char *bytes = (const unsigned char *)rects;
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (size_t i = 0; i < count * sizeof(struct xdwl_rect); i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+
+  return hash;
+}
+
+static void region_unlink(struct xdwl_region_cache *cache,
+                          struct xdwl_region_entry *entry) {
+  struct xdwl_region_entry **first = xdwl_map_get(cache->entries, entry->hash);
+  struct xdwl_region_entry **e = first;
+
+  while (*e != entry)
+    e = &(*e)->next;
+  *e = entry->next;
+
+  if (*first == NULL)
+    xdwl_map_remove(cache->entries, entry->hash);
+
+  xdwl_ilist_remove(&cache->lru, &entry->link);
+}
+
+static void region_destroy(struct xdwl_region_cache *cache,
+                           struct xdwl_region_entry *entry) {
+  if (xdwl_region_destroy(cache->proxy, entry->region_id) == -1 ||
+      xdwl_object_unregister(cache->proxy, entry->region_id) == -1)
+    xdwl_error_print();
+
+  free(entry);
+}
+
+struct xdwl_region_cache *
+xdwl_region_cache_create(xdwl_proxy *proxy, xdwl_id wl_compositor_id,
+                         size_t capacity) {
+  struct xdwl_region_cache *cache = malloc(sizeof(struct xdwl_region_cache));
+  if (!cache) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_region_cache_create: failed to malloc()");
+    return NULL;
+  }
+
+  cache->proxy = proxy;
+  cache->compositor_id = wl_compositor_id;
+  cache->capacity = capacity ? capacity : XDWL_REGION_CACHE_DEFAULT_SIZE;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->evictions = 0;
+  xdwl_ilist_init(&cache->lru);
+
+  cache->entries = xdwl_map_new(cache->capacity);
+  if (!cache->entries) {
+    free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+void xdwl_region_cache_destroy(struct xdwl_region_cache *cache) {
+  struct xdwl_link *link, *tmp;
+
+  if (!cache)
+    return;
+
+  xdwl_ilist_for_each_safe(link, tmp, &cache->lru) {
+    region_destroy(cache, entry_of(link));
+  }
+
+  xdwl_map_destroy(cache->entries);
+  free(cache);
+}
+
+static struct xdwl_region_entry *
+region_create(struct xdwl_region_cache *cache, const struct xdwl_rect *rects,
+              size_t count, size_t hash) {
+  struct xdwl_region_entry *entry = malloc(
+      sizeof(struct xdwl_region_entry) + count * sizeof(struct xdwl_rect));
+  if (!entry) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_region_cache_get: failed to malloc()");
+    return NULL;
+  }
+
+  entry->region_id = xdwl_object_register(cache->proxy, 0, "wl_region");
+  if (entry->region_id == 0) {
+    free(entry);
+    return NULL;
+  }
+
+  if (xdwl_compositor_create_region(cache->proxy, cache->compositor_id,
+                                    entry->region_id) == -1) {
+    if (xdwl_object_unregister(cache->proxy, entry->region_id) == -1)
+      xdwl_error_print();
+    free(entry);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (xdwl_region_add(cache->proxy, entry->region_id, rects[i].x,
+                        rects[i].y, rects[i].width, rects[i].height) == -1) {
+      region_destroy(cache, entry);
+      return NULL;
+    }
+  }
+
+  entry->hash = hash;
+  entry->count = count;
+  if (count)
+    memcpy(entry->rects, rects, count * sizeof(struct xdwl_rect));
+
+  return entry;
+}
+
+xdwl_id xdwl_region_cache_get(struct xdwl_region_cache *cache,
+                              const struct xdwl_rect *rects, size_t count) {
+  size_t hash = region_hash(rects, count);
+  struct xdwl_region_entry **first = xdwl_map_get(cache->entries, hash);
+
+  if (first) {
+    for (struct xdwl_region_entry *e = *first; e; e = e->next) {
+      if (e->count != count ||
+          memcmp(e->rects, rects, count * sizeof(struct xdwl_rect)) != 0)
+        continue;
+
+      xdwl_ilist_remove(&cache->lru, &e->link);
+      xdwl_ilist_push_front(&cache->lru, &e->link);
+      cache->hits++;
+      return e->region_id;
+    }
+  }
+
+  cache->misses++;
+
+  // evict first, the new region can take the id that frees up
+  if (cache->lru.length >= cache->capacity) {
+    struct xdwl_region_entry *lru = entry_of(xdwl_ilist_last(&cache->lru));
+    region_unlink(cache, lru);
+    region_destroy(cache, lru);
+    cache->evictions++;
+  }
+
+  struct xdwl_region_entry *entry = region_create(cache, rects, count, hash);
+  if (!entry)
+    return 0;
+
+  // the eviction may have moved or dropped the chain head
+  first = xdwl_map_get(cache->entries, hash);
+  entry->next = first ? *first : NULL;
+
+  if (xdwl_map_set(cache->entries, hash, &entry, sizeof(entry)) == NULL) {
+    region_destroy(cache, entry);
+    return 0;
+  }
+
+  xdwl_ilist_push_front(&cache->lru, &entry->link);
+  return entry->region_id;
+}
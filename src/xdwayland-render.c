@@ -0,0 +1,416 @@
+#include "xdwayland-render.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+
+// a worker's share of the tile array, next in the low half and end in the
+// high half so the owner popping from the front and thieves splitting off
+// the back both get away with a single compare and swap
+#define RANGE(next, end) ((uint64_t)(end) << 32 | (uint32_t)(next))
+#define RANGE_NEXT(r) ((uint32_t)(r))
+#define RANGE_END(r) ((uint32_t)((r) >> 32))
+
+struct render_worker {
+  struct xdwl_renderer *renderer;
+  size_t index;
+  pthread_t thread;
+  uint64_t range;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct xdwl_renderer {
+  size_t thread_count;
+  int32_t tile_size;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  uint64_t generation;
+  size_t running;
+  int quit;
+
+  // the job, only written by draw while every worker is parked
+  struct xdwl_image *image;
+  xdwl_tile_renderer *render;
+  void *user_data;
+  struct xdwl_rect *tiles;
+  size_t tile_count;
+  size_t tile_capacity;
+
+  struct render_worker *workers;
+};
+
+static int rect_intersect(struct xdwl_rect *out, const struct xdwl_rect *a,
+                          const struct xdwl_rect *b) {
+  int32_t x1 = a->x > b->x ? a->x : b->x;
+  int32_t y1 = a->y > b->y ? a->y : b->y;
+  int32_t x2 = a->x + a->width < b->x + b->width ? a->x + a->width
+                                                 : b->x + b->width;
+  int32_t y2 = a->y + a->height < b->y + b->height ? a->y + a->height
+                                                   : b->y + b->height;
+
+  if (x2 <= x1 || y2 <= y1)
+    return 0;
+
+  out->x = x1;
+  out->y = y1;
+  out->width = x2 - x1;
+  out->height = y2 - y1;
+  return 1;
+}
+
+static int render_pop(struct render_worker *worker, uint32_t *tile) {
+  uint64_t range = __atomic_load_n(&worker->range, __ATOMIC_ACQUIRE);
+
+  while (RANGE_NEXT(range) < RANGE_END(range)) {
+    uint64_t popped = RANGE(RANGE_NEXT(range) + 1, RANGE_END(range));
+    if (__atomic_compare_exchange_n(&worker->range, &range, popped, 1,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      *tile = RANGE_NEXT(range);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// takes the back half of the first non-empty range after the thief's own.
+// tiles are never handed out twice, so a range can't come back to a value
+// a racing thief has already read
+static int render_steal(struct xdwl_renderer *renderer,
+                        struct render_worker *thief) {
+  for (size_t i = 1; i < renderer->thread_count; i++) {
+    struct render_worker *victim =
+        &renderer->workers[(thief->index + i) % renderer->thread_count];
+    uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+
+    while (RANGE_NEXT(range) < RANGE_END(range)) {
+      uint32_t next = RANGE_NEXT(range);
+      uint32_t end = RANGE_END(range);
+      uint32_t half = (end - next + 1) / 2;
+
+      if (__atomic_compare_exchange_n(&victim->range, &range,
+                                      RANGE(next, end - half), 1,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&thief->range, RANGE(end - half, end),
+                         __ATOMIC_RELEASE);
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static void render_run(struct xdwl_renderer *renderer,
+                       struct render_worker *worker) {
+  uint32_t tile;
+
+  do {
+    while (render_pop(worker, &tile))
+      renderer->render(renderer->user_data, renderer->image,
+                       renderer->tiles[tile]);
+  } while (render_steal(renderer, worker));
+}
+
+static void *render_worker_main(void *data) {
+  struct render_worker *worker = data;
+  struct xdwl_renderer *renderer = worker->renderer;
+  uint64_t seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&renderer->lock);
+    while (renderer->generation == seen && !renderer->quit)
+      pthread_cond_wait(&renderer->start, &renderer->lock);
+
+    if (renderer->quit) {
+      pthread_mutex_unlock(&renderer->lock);
+      return NULL;
+    }
+
+    seen = renderer->generation;
+    pthread_mutex_unlock(&renderer->lock);
+
+    render_run(renderer, worker);
+
+    pthread_mutex_lock(&renderer->lock);
+    if (--renderer->running == 0)
+      pthread_cond_signal(&renderer->done);
+    pthread_mutex_unlock(&renderer->lock);
+  }
+}
+
+static void render_stop(struct xdwl_renderer *renderer, size_t started) {
+  pthread_mutex_lock(&renderer->lock);
+  renderer->quit = 1;
+  pthread_cond_broadcast(&renderer->start);
+  pthread_mutex_unlock(&renderer->lock);
+
+  for (size_t i = 1; i < started; i++)
+    pthread_join(renderer->workers[i].thread, NULL);
+}
+
+struct xdwl_renderer *xdwl_renderer_create(size_t thread_count,
+                                           int32_t tile_size) {
+  if (thread_count == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = online > 0 ? online : 1;
+  }
+  if (thread_count > XDWL_RENDER_MAX_THREADS)
+    thread_count = XDWL_RENDER_MAX_THREADS;
+
+  if (tile_size <= 0) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_renderer_create: invalid tile size %d", tile_size);
+    return NULL;
+  }
+
+  struct xdwl_renderer *renderer = calloc(1, sizeof(struct xdwl_renderer));
+  if (!renderer) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_renderer_create: failed to calloc()");
+    return NULL;
+  }
+
+  renderer->thread_count = thread_count;
+  renderer->tile_size = tile_size;
+
+  // one cache line per worker, the ranges are hammered from every thread
+  if (posix_memalign((void **)&renderer->workers, CACHE_LINE,
+                     thread_count * sizeof(struct render_worker)) != 0) {
+    perror("posix_memalign");
+    xdwl_error_set(XDWLERR_STD,
+                   "xdwl_renderer_create: failed to posix_memalign()");
+    free(renderer);
+    return NULL;
+  }
+
+  pthread_mutex_init(&renderer->lock, NULL);
+  pthread_cond_init(&renderer->start, NULL);
+  pthread_cond_init(&renderer->done, NULL);
+
+  // worker 0 is whoever calls draw
+  for (size_t i = 0; i < thread_count; i++) {
+    struct render_worker *worker = &renderer->workers[i];
+    worker->renderer = renderer;
+    worker->index = i;
+    worker->range = 0;
+
+    if (i == 0)
+      continue;
+
+    if (pthread_create(&worker->thread, NULL, render_worker_main, worker) !=
+        0) {
+      perror("pthread_create");
+      xdwl_error_set(XDWLERR_STD,
+                     "xdwl_renderer_create: failed to pthread_create()");
+      render_stop(renderer, i);
+      pthread_cond_destroy(&renderer->done);
+      pthread_cond_destroy(&renderer->start);
+      pthread_mutex_destroy(&renderer->lock);
+      free(renderer->workers);
+      free(renderer);
+      return NULL;
+    }
+  }
+
+  return renderer;
+}
+
+void xdwl_renderer_destroy(struct xdwl_renderer *renderer) {
+  if (!renderer)
+    return;
+
+  render_stop(renderer, renderer->thread_count);
+
+  pthread_cond_destroy(&renderer->done);
+  pthread_cond_destroy(&renderer->start);
+  pthread_mutex_destroy(&renderer->lock);
+
+  free(renderer->tiles);
+  free(renderer->workers);
+  free(renderer);
+}
+
+// fills renderer->tiles with every tile touched by damage, each clipped to
+// the bounding box of the damage inside it
+static int render_schedule(struct xdwl_renderer *renderer,
+                           struct xdwl_image *image,
+                           const struct xdwl_damage *damage) {
+  int32_t tile_size = renderer->tile_size;
+  size_t cols = (image->width + tile_size - 1) / tile_size;
+  size_t rows = (image->height + tile_size - 1) / tile_size;
+
+  if (cols * rows > UINT32_MAX) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_renderer_draw: too many tiles for a %dx%d image",
+                   image->width, image->height);
+    return -1;
+  }
+
+  if (cols * rows > renderer->tile_capacity) {
+    struct xdwl_rect *tiles =
+        realloc(renderer->tiles, cols * rows * sizeof(struct xdwl_rect));
+    if (!tiles) {
+      perror("realloc");
+      xdwl_error_set(XDWLERR_STD, "xdwl_renderer_draw: failed to realloc()");
+      return -1;
+    }
+
+    renderer->tiles = tiles;
+    renderer->tile_capacity = cols * rows;
+  }
+
+  renderer->tile_count = 0;
+
+  for (size_t row = 0; row < rows; row++) {
+    for (size_t col = 0; col < cols; col++) {
+      struct xdwl_rect tile = {col * tile_size, row * tile_size, tile_size,
+                               tile_size};
+      if (tile.x + tile.width > image->width)
+        tile.width = image->width - tile.x;
+      if (tile.y + tile.height > image->height)
+        tile.height = image->height - tile.y;
+
+      if (!damage) {
+        renderer->tiles[renderer->tile_count++] = tile;
+        continue;
+      }
+
+      struct xdwl_rect clip = {0, 0, 0, 0};
+      int32_t x2 = 0, y2 = 0;
+
+      for (size_t i = 0; i < damage->count; i++) {
+        struct xdwl_rect part;
+        if (!rect_intersect(&part, &tile, &damage->rects[i]))
+          continue;
+
+        if (clip.width == 0) {
+          clip = part;
+          x2 = part.x + part.width;
+          y2 = part.y + part.height;
+          continue;
+        }
+
+        if (part.x < clip.x)
+          clip.x = part.x;
+        if (part.y < clip.y)
+          clip.y = part.y;
+        if (part.x + part.width > x2)
+          x2 = part.x + part.width;
+        if (part.y + part.height > y2)
+          y2 = part.y + part.height;
+      }
+
+      if (clip.width == 0)
+        continue;
+
+      clip.width = x2 - clip.x;
+      clip.height = y2 - clip.y;
+      renderer->tiles[renderer->tile_count++] = clip;
+    }
+  }
+
+  return 0;
+}
+
+int xdwl_renderer_draw(struct xdwl_renderer *renderer,
+                       struct xdwl_image *image,
+                       const struct xdwl_damage *damage,
+                       xdwl_tile_renderer *render, void *user_data,
+                       struct xdwl_damage *out_damage) {
+  if (!render) {
+    xdwl_error_set(XDWLERR_NULLARG, "xdwl_renderer_draw: render is NULL");
+    return -1;
+  }
+
+  if (render_schedule(renderer, image, damage) == -1)
+    return -1;
+
+  if (renderer->tile_count == 0)
+    return 0;
+
+  renderer->image = image;
+  renderer->render = render;
+  renderer->user_data = user_data;
+
+  // contiguous shares keep neighbouring tiles, and the source rows they
+  // read, on the same core until someone runs dry and steals
+  size_t workers = renderer->thread_count;
+  if (workers > renderer->tile_count)
+    workers = renderer->tile_count;
+
+  for (size_t i = 0; i < renderer->thread_count; i++) {
+    uint32_t next = i < workers ? i * renderer->tile_count / workers : 0;
+    uint32_t end = i < workers ? (i + 1) * renderer->tile_count / workers : 0;
+    __atomic_store_n(&renderer->workers[i].range, RANGE(next, end),
+                     __ATOMIC_RELAXED);
+  }
+
+  if (workers > 1) {
+    pthread_mutex_lock(&renderer->lock);
+    renderer->running = renderer->thread_count - 1;
+    renderer->generation++;
+    pthread_cond_broadcast(&renderer->start);
+    pthread_mutex_unlock(&renderer->lock);
+  }
+
+  render_run(renderer, &renderer->workers[0]);
+
+  if (workers > 1) {
+    pthread_mutex_lock(&renderer->lock);
+    while (renderer->running > 0)
+      pthread_cond_wait(&renderer->done, &renderer->lock);
+    pthread_mutex_unlock(&renderer->lock);
+  }
+
+  if (out_damage) {
+    for (size_t i = 0; i < renderer->tile_count; i++) {
+      struct xdwl_rect *tile = &renderer->tiles[i];
+      xdwl_damage_add(out_damage, tile->x, tile->y, tile->width,
+                      tile->height);
+    }
+  }
+
+  return 0;
+}
+
+int xdwl_renderer_present(struct xdwl_renderer *renderer, xdwl_proxy *proxy,
+                          xdwl_id wl_surface_id,
+                          struct xdwl_swapchain_buffer *buffer,
+                          const struct xdwl_damage *damage,
+                          xdwl_tile_renderer *render, void *user_data) {
+  struct xdwl_shm_buffer *shm = buffer->shm;
+  struct xdwl_image image = {shm->data, shm->width, shm->height, shm->stride,
+                             shm->format};
+  struct xdwl_damage repaint;
+  struct xdwl_damage rendered;
+
+  // the buffer may be a few frames behind, whatever changed since it was
+  // last shown is repainted along with this frame's damage
+  if (damage) {
+    repaint = buffer->damage;
+    xdwl_damage_add_damage(&repaint, damage);
+  }
+
+  xdwl_damage_init(&rendered, 0);
+
+  // draw only returns once every worker is parked again, nothing touches
+  // the buffer after the compositor is allowed to read it
+  if (xdwl_renderer_draw(renderer, &image, damage ? &repaint : NULL, render,
+                         user_data, &rendered) == -1)
+    return -1;
+
+  if (xdwl_surface_attach(proxy, wl_surface_id, shm->id, 0, 0) == -1)
+    return -1;
+
+  if (xdwl_damage_commit(proxy, wl_surface_id, &rendered) == -1)
+    return -1;
+
+  xdwl_swapchain_submit(buffer->swapchain, buffer, damage);
+  return 0;
+}
@@ -51,6 +51,7 @@ def generate_requests(interface_name: str, cur: ET.Element, *, header: bool) ->
 
             args = []
             signature = ""
+            new_id = ""
 
             if interface_name == "wl_registry" and request_name == "bind":
                 method += "uint32_t _name, const char *_interface, uint32_t _version, xdwl_id _new_id, "
@@ -63,6 +64,9 @@ def generate_requests(interface_name: str, cur: ET.Element, *, header: bool) ->
                     arg_type = arg.get("type")
                     args.append(arg_name)
 
+                    if arg_type == "new_id" and arg.get("interface"):
+                        new_id = f', "{arg.get("interface")}", {len(args) - 1}'
+
                     match arg_type:
                         case "int" | "enum":
                             method += f"int32_t {arg_name}"
@@ -97,7 +101,7 @@ def generate_requests(interface_name: str, cur: ET.Element, *, header: bool) ->
                     else:
                         method += f'    return xdwl_send_request(proxy, 1, "{interface_name}", {i}, {len(args)}, {", ".join(args)});\n'
 
-                    request_struct += f'{len(args)}, "{signature}"}},\n'
+                    request_struct += f'{len(args)}, "{signature}"{new_id}}},\n'
 
                 else:
                     if interface_name != "wl_display":
@@ -153,12 +157,16 @@ def generate_events(interface_name: str, cur: ET.Element, *, header: bool) -> tu
             else:
                 args = []
                 signature = ""
+                new_id = ""
 
                 for arg in event.findall("./arg"):
                     arg_name = "_" + arg.get("name", "")
                     arg_type = arg.get("type")
                     args.append(arg_name)
 
+                    if arg_type == "new_id" and arg.get("interface"):
+                        new_id = f', "{arg.get("interface")}", {len(args) - 1}'
+
                     match arg_type:
                         case "int" | "enum":
                             signature += "i"
@@ -176,7 +184,7 @@ def generate_events(interface_name: str, cur: ET.Element, *, header: bool) -> tu
                             signature += "s"
 
                 if args:
-                    event_struct += f'{len(args)}, "{signature}"}},\n'
+                    event_struct += f'{len(args)}, "{signature}"{new_id}}},\n'
 
                 else:
                     event_struct += f"0, NULL}},\n"
@@ -225,9 +233,11 @@ def generate_interface_struct(cur: ET.Element, interface_name: str) -> str:
 
     if cur.find("./request") is not None:
         struct += f"    .requests = xd{interface_name}_requests,\n"
+        struct += f"    .request_count = {len(cur.findall('./request'))},\n"
 
     if cur.find("./event") is not None:
         struct += f"    .events = xd{interface_name}_events,\n"
+        struct += f"    .event_count = {len(cur.findall('./event'))},\n"
 
     struct += "};"
 
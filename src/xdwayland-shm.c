@@ -0,0 +1,548 @@
+#define _GNU_SOURCE
+#include "xdwayland-shm.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+#define HUGE_PAGE_SIZE (2 << 20)
+#define BLOCK_ALIGN 64
+#define BLOCKS_PER_SLAB 32
+#define BUFFERS_PER_SLAB 8
+#define ALIGNED(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+struct xdwl_shm_block {
+  struct xdwl_link link;
+  size_t offset;
+  size_t size;
+};
+
+#define block_of(l) xdwl_container_of(l, struct xdwl_shm_block, link)
+#define buffer_of(l) xdwl_container_of(l, struct xdwl_shm_buffer, link)
+
+// inserts [offset, offset + size) into the free list, merging neighbours
+static int shm_free_range(struct xdwl_shm_allocator *allocator, size_t offset,
+                          size_t size) {
+  struct xdwl_link *link;
+  struct xdwl_shm_block *prev = NULL, *next = NULL;
+
+  xdwl_ilist_for_each(link, &allocator->free_blocks) {
+    struct xdwl_shm_block *block = block_of(link);
+    if (block->offset > offset) {
+      next = block;
+      break;
+    }
+    prev = block;
+  }
+
+  if (prev && prev->offset + prev->size == offset) {
+    prev->size += size;
+
+    if (next && prev->offset + prev->size == next->offset) {
+      prev->size += next->size;
+      xdwl_ilist_remove(&allocator->free_blocks, &next->link);
+      xdwl_pool_free(allocator->block_pool, next);
+    }
+    return 0;
+  }
+
+  if (next && offset + size == next->offset) {
+    next->offset = offset;
+    next->size += size;
+    return 0;
+  }
+
+  struct xdwl_shm_block *block = xdwl_pool_alloc(allocator->block_pool);
+  if (!block)
+    return -1;
+
+  block->offset = offset;
+  block->size = size;
+
+  if (prev)
+    xdwl_ilist_insert_after(&allocator->free_blocks, &prev->link,
+                            &block->link);
+  else
+    xdwl_ilist_push_front(&allocator->free_blocks, &block->link);
+
+  return 0;
+}
+
+static long shm_minor_faults() {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == -1)
+    return 0;
+
+  return usage.ru_minflt;
+}
+
+static void shm_populate(char *start, size_t size, size_t page_size) {
+  if (madvise(start, size, MADV_POPULATE_WRITE) == 0)
+    return;
+
+  // MADV_POPULATE_WRITE is 5.14+, the range is fresh so writing zeroes to
+  // every page is the same thing
+  for (size_t i = 0; i < size; i += page_size)
+    ((volatile char *)start)[i] = 0;
+}
+
+// size bytes were just mapped, faults is the minor fault count from before
+static void shm_account(struct xdwl_shm_allocator *allocator, size_t size,
+                        long faults) {
+  struct xdwl_shm_stats *stats = &allocator->stats;
+  size_t base_page_size = sysconf(_SC_PAGESIZE);
+
+  if (allocator->hugetlb)
+    stats->hugetlb_bytes += size;
+
+  if (allocator->flags & XDWL_SHM_POPULATE) {
+    stats->populated_bytes += size;
+    stats->populate_faults += shm_minor_faults() - faults;
+    stats->faults_avoided += size / base_page_size;
+  } else if (allocator->hugetlb) {
+    stats->faults_avoided +=
+        size / base_page_size - size / allocator->page_size;
+  }
+}
+
+// memfd, ftruncate and mmap in one go, so a hugetlbfs attempt that runs out
+// of reserved pages at any step can be retried without them
+static int shm_map(struct xdwl_shm_allocator *allocator, size_t size,
+                   unsigned int mfd_flags, int report) {
+  int map_flags = MAP_SHARED;
+  // transparent huge pages only help if the advice comes before the faults
+  int advise = (allocator->flags & XDWL_SHM_HUGEPAGE) &&
+               !(mfd_flags & MFD_HUGETLB);
+
+  if ((allocator->flags & XDWL_SHM_POPULATE) && !advise)
+    map_flags |= MAP_POPULATE;
+
+  int fd = memfd_create("xdwayland-shm", mfd_flags);
+  if (fd == -1) {
+    if (report) {
+      perror("memfd_create");
+      xdwl_error_set(XDWLERR_STD,
+                     "xdwl_shm_allocator_create: failed to memfd_create()");
+    }
+    return -1;
+  }
+
+  if (ftruncate(fd, size) == -1) {
+    if (report) {
+      perror("ftruncate");
+      xdwl_error_set(XDWLERR_STD,
+                     "xdwl_shm_allocator_create: failed to ftruncate()");
+    }
+    close(fd);
+    return -1;
+  }
+
+  char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, map_flags, fd, 0);
+  if (data == MAP_FAILED) {
+    if (report) {
+      perror("mmap");
+      xdwl_error_set(XDWLERR_STD, "xdwl_shm_allocator_create: failed to mmap()");
+    }
+    close(fd);
+    return -1;
+  }
+
+  if (advise) {
+    madvise(data, size, MADV_HUGEPAGE);
+    if (allocator->flags & XDWL_SHM_POPULATE)
+      shm_populate(data, size, allocator->page_size);
+  }
+
+  allocator->fd = fd;
+  allocator->data = data;
+  allocator->size = size;
+  return 0;
+}
+
+static int shm_grow(struct xdwl_shm_allocator *allocator, size_t needed) {
+  size_t old_size = allocator->size;
+  size_t new_size = old_size * 2;
+  long faults = shm_minor_faults();
+
+  if (new_size < old_size + needed)
+    new_size = old_size + needed;
+  new_size = ALIGNED(new_size, allocator->page_size);
+
+  if (new_size > INT32_MAX) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_shm_buffer_create: pool can't grow to %ld bytes",
+                   new_size);
+    return -1;
+  }
+
+  if (ftruncate(allocator->fd, new_size) == -1) {
+    perror("ftruncate");
+    xdwl_error_set(XDWLERR_STD, "xdwl_shm_buffer_create: failed to grow pool");
+    return -1;
+  }
+
+  char *data = mremap(allocator->data, old_size, new_size, MREMAP_MAYMOVE);
+  if (data == MAP_FAILED) {
+    perror("mremap");
+    xdwl_error_set(XDWLERR_STD, "xdwl_shm_buffer_create: failed to mremap()");
+    return -1;
+  }
+
+  // the old mapping is gone whether or not the resize goes out
+  allocator->data = data;
+  allocator->size = new_size;
+
+  struct xdwl_link *link;
+  xdwl_ilist_for_each(link, &allocator->buffers) {
+    struct xdwl_shm_buffer *buffer = buffer_of(link);
+    buffer->data = data + buffer->offset;
+  }
+
+  if (xdwl_shm_pool_resize(allocator->proxy, allocator->pool_id, new_size) ==
+      -1) {
+    return -1;
+  }
+
+  if ((allocator->flags & XDWL_SHM_HUGEPAGE) && !allocator->hugetlb)
+    madvise(data + old_size, new_size - old_size, MADV_HUGEPAGE);
+  if (allocator->flags & XDWL_SHM_POPULATE)
+    shm_populate(data + old_size, new_size - old_size, allocator->page_size);
+  shm_account(allocator, new_size - old_size, faults);
+
+  return shm_free_range(allocator, old_size, new_size - old_size);
+}
+
+// bits per pixel of the first plane, formats not listed take a byte
+static int shm_format_bits(uint32_t format) {
+  switch (format) {
+  case XDWL_SHM_FORMAT_C1:
+  case XDWL_SHM_FORMAT_D1:
+  case XDWL_SHM_FORMAT_R1:
+    return 1;
+  case XDWL_SHM_FORMAT_C2:
+  case XDWL_SHM_FORMAT_D2:
+  case XDWL_SHM_FORMAT_R2:
+    return 2;
+  case XDWL_SHM_FORMAT_C4:
+  case XDWL_SHM_FORMAT_D4:
+  case XDWL_SHM_FORMAT_R4:
+    return 4;
+  case XDWL_SHM_FORMAT_XRGB4444:
+  case XDWL_SHM_FORMAT_XBGR4444:
+  case XDWL_SHM_FORMAT_RGBX4444:
+  case XDWL_SHM_FORMAT_BGRX4444:
+  case XDWL_SHM_FORMAT_ARGB4444:
+  case XDWL_SHM_FORMAT_ABGR4444:
+  case XDWL_SHM_FORMAT_RGBA4444:
+  case XDWL_SHM_FORMAT_BGRA4444:
+  case XDWL_SHM_FORMAT_XRGB1555:
+  case XDWL_SHM_FORMAT_XBGR1555:
+  case XDWL_SHM_FORMAT_RGBX5551:
+  case XDWL_SHM_FORMAT_BGRX5551:
+  case XDWL_SHM_FORMAT_ARGB1555:
+  case XDWL_SHM_FORMAT_ABGR1555:
+  case XDWL_SHM_FORMAT_RGBA5551:
+  case XDWL_SHM_FORMAT_BGRA5551:
+  case XDWL_SHM_FORMAT_RGB565:
+  case XDWL_SHM_FORMAT_BGR565:
+  case XDWL_SHM_FORMAT_RGB565_A8:
+  case XDWL_SHM_FORMAT_BGR565_A8:
+  case XDWL_SHM_FORMAT_R10:
+  case XDWL_SHM_FORMAT_R12:
+  case XDWL_SHM_FORMAT_R16:
+  case XDWL_SHM_FORMAT_RG88:
+  case XDWL_SHM_FORMAT_GR88:
+  case XDWL_SHM_FORMAT_YUYV:
+  case XDWL_SHM_FORMAT_YVYU:
+  case XDWL_SHM_FORMAT_UYVY:
+  case XDWL_SHM_FORMAT_VYUY:
+  case XDWL_SHM_FORMAT_P010:
+  case XDWL_SHM_FORMAT_P012:
+  case XDWL_SHM_FORMAT_P016:
+  case XDWL_SHM_FORMAT_P210:
+    return 16;
+  case XDWL_SHM_FORMAT_RGB888:
+  case XDWL_SHM_FORMAT_BGR888:
+  case XDWL_SHM_FORMAT_RGB888_A8:
+  case XDWL_SHM_FORMAT_BGR888_A8:
+  case XDWL_SHM_FORMAT_VUY888:
+    return 24;
+  case XDWL_SHM_FORMAT_ARGB8888:
+  case XDWL_SHM_FORMAT_XRGB8888:
+  case XDWL_SHM_FORMAT_XBGR8888:
+  case XDWL_SHM_FORMAT_RGBX8888:
+  case XDWL_SHM_FORMAT_BGRX8888:
+  case XDWL_SHM_FORMAT_ABGR8888:
+  case XDWL_SHM_FORMAT_RGBA8888:
+  case XDWL_SHM_FORMAT_BGRA8888:
+  case XDWL_SHM_FORMAT_XRGB8888_A8:
+  case XDWL_SHM_FORMAT_XBGR8888_A8:
+  case XDWL_SHM_FORMAT_RGBX8888_A8:
+  case XDWL_SHM_FORMAT_BGRX8888_A8:
+  case XDWL_SHM_FORMAT_XRGB2101010:
+  case XDWL_SHM_FORMAT_XBGR2101010:
+  case XDWL_SHM_FORMAT_RGBX1010102:
+  case XDWL_SHM_FORMAT_BGRX1010102:
+  case XDWL_SHM_FORMAT_ARGB2101010:
+  case XDWL_SHM_FORMAT_ABGR2101010:
+  case XDWL_SHM_FORMAT_RGBA1010102:
+  case XDWL_SHM_FORMAT_BGRA1010102:
+  case XDWL_SHM_FORMAT_RG1616:
+  case XDWL_SHM_FORMAT_GR1616:
+  case XDWL_SHM_FORMAT_AYUV:
+  case XDWL_SHM_FORMAT_XYUV8888:
+  case XDWL_SHM_FORMAT_AVUY8888:
+  case XDWL_SHM_FORMAT_XVUY8888:
+  case XDWL_SHM_FORMAT_Y210:
+  case XDWL_SHM_FORMAT_Y212:
+  case XDWL_SHM_FORMAT_Y216:
+  case XDWL_SHM_FORMAT_Y410:
+  case XDWL_SHM_FORMAT_XVYU2101010:
+    return 32;
+  case XDWL_SHM_FORMAT_XRGB16161616F:
+  case XDWL_SHM_FORMAT_XBGR16161616F:
+  case XDWL_SHM_FORMAT_ARGB16161616F:
+  case XDWL_SHM_FORMAT_ABGR16161616F:
+  case XDWL_SHM_FORMAT_XRGB16161616:
+  case XDWL_SHM_FORMAT_XBGR16161616:
+  case XDWL_SHM_FORMAT_ARGB16161616:
+  case XDWL_SHM_FORMAT_ABGR16161616:
+  case XDWL_SHM_FORMAT_AXBXGXRX106106106106:
+  case XDWL_SHM_FORMAT_Y412:
+  case XDWL_SHM_FORMAT_Y416:
+  case XDWL_SHM_FORMAT_XVYU12_16161616:
+  case XDWL_SHM_FORMAT_XVYU16161616:
+    return 64;
+  default:
+    return 8;
+  }
+}
+
+static struct xdwl_shm_block *
+shm_best_fit(struct xdwl_shm_allocator *allocator, size_t size) {
+  struct xdwl_link *link;
+  struct xdwl_shm_block *best = NULL;
+
+  xdwl_ilist_for_each(link, &allocator->free_blocks) {
+    struct xdwl_shm_block *block = block_of(link);
+    if (block->size >= size && (!best || block->size < best->size)) {
+      best = block;
+      if (block->size == size)
+        break;
+    }
+  }
+
+  return best;
+}
+
+struct xdwl_shm_allocator *
+xdwl_shm_allocator_create(xdwl_proxy *proxy, xdwl_id wl_shm_id, size_t size,
+                          uint32_t flags) {
+  size = ALIGNED(size ? size : 1, sysconf(_SC_PAGESIZE));
+  if (size > INT32_MAX) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_shm_allocator_create: %ld bytes is too big for a pool",
+                   size);
+    return NULL;
+  }
+
+  struct xdwl_shm_allocator *allocator =
+      calloc(1, sizeof(struct xdwl_shm_allocator));
+  if (!allocator) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_shm_allocator_create: failed to calloc()");
+    return NULL;
+  }
+
+  allocator->proxy = proxy;
+  allocator->shm_id = wl_shm_id;
+  allocator->flags = flags;
+  allocator->page_size = sysconf(_SC_PAGESIZE);
+  xdwl_ilist_init(&allocator->free_blocks);
+  xdwl_ilist_init(&allocator->buffers);
+
+  allocator->block_pool =
+      xdwl_pool_new(sizeof(struct xdwl_shm_block), BLOCKS_PER_SLAB);
+  allocator->buffer_pool =
+      xdwl_pool_new(sizeof(struct xdwl_shm_buffer), BUFFERS_PER_SLAB);
+  if (!allocator->block_pool || !allocator->buffer_pool)
+    goto err_pools;
+
+  unsigned int mfd_flags = MFD_CLOEXEC;
+  if (flags & XDWL_SHM_SEAL)
+    mfd_flags |= MFD_ALLOW_SEALING;
+
+  long faults = shm_minor_faults();
+  int mapped = -1;
+
+#ifdef MFD_HUGETLB
+  // without hugetlbfs or reserved huge pages this fails somewhere along the
+  // way, transparent huge pages are the fallback
+  if (flags & XDWL_SHM_HUGEPAGE) {
+    size_t huge_size = ALIGNED(size, HUGE_PAGE_SIZE);
+    if (huge_size <= INT32_MAX &&
+        shm_map(allocator, huge_size, mfd_flags | MFD_HUGETLB, 0) == 0) {
+      allocator->hugetlb = 1;
+      allocator->page_size = HUGE_PAGE_SIZE;
+      mapped = 0;
+    }
+  }
+#endif
+
+  if (mapped == -1 && shm_map(allocator, size, mfd_flags, 1) == -1)
+    goto err_pools;
+
+  shm_account(allocator, allocator->size, faults);
+
+  if ((flags & XDWL_SHM_SEAL) &&
+      fcntl(allocator->fd, F_ADD_SEALS, F_SEAL_SHRINK) == -1) {
+    perror("fcntl");
+    xdwl_error_set(XDWLERR_STD,
+                   "xdwl_shm_allocator_create: failed to seal the pool");
+    goto err_map;
+  }
+
+  if (shm_free_range(allocator, 0, allocator->size) == -1)
+    goto err_map;
+
+  allocator->pool_id = xdwl_object_register(proxy, 0, "wl_shm_pool");
+  if (allocator->pool_id == 0)
+    goto err_map;
+
+  if (xdwl_shm_create_pool(proxy, wl_shm_id, allocator->pool_id,
+                           allocator->fd, allocator->size) == -1) {
+    if (xdwl_object_unregister(proxy, allocator->pool_id) == -1)
+      xdwl_error_print();
+    goto err_map;
+  }
+
+  return allocator;
+
+err_map:
+  munmap(allocator->data, allocator->size);
+  close(allocator->fd);
+err_pools:
+  xdwl_pool_destroy(allocator->block_pool);
+  xdwl_pool_destroy(allocator->buffer_pool);
+  free(allocator);
+  return NULL;
+}
+
+void xdwl_shm_allocator_destroy(struct xdwl_shm_allocator *allocator) {
+  struct xdwl_link *link, *tmp;
+
+  if (!allocator)
+    return;
+
+  xdwl_ilist_for_each_safe(link, tmp, &allocator->buffers) {
+    xdwl_shm_buffer_destroy(buffer_of(link));
+  }
+
+  if (xdwl_shm_pool_destroy(allocator->proxy, allocator->pool_id) == -1 ||
+      xdwl_object_unregister(allocator->proxy, allocator->pool_id) == -1)
+    xdwl_error_print();
+
+  munmap(allocator->data, allocator->size);
+  close(allocator->fd);
+
+  xdwl_pool_destroy(allocator->block_pool);
+  xdwl_pool_destroy(allocator->buffer_pool);
+  free(allocator);
+}
+
+void xdwl_shm_allocator_get_stats(struct xdwl_shm_allocator *allocator,
+                                  struct xdwl_shm_stats *stats) {
+  *stats = allocator->stats;
+}
+
+struct xdwl_shm_buffer *
+xdwl_shm_buffer_create(struct xdwl_shm_allocator *allocator, int32_t width,
+                       int32_t height, int32_t stride, uint32_t format) {
+  if (width <= 0 || height <= 0 ||
+      stride < ((int64_t)width * shm_format_bits(format) + 7) / 8) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_shm_buffer_create: invalid buffer size %dx%d, "
+                   "stride %d",
+                   width, height, stride);
+    return NULL;
+  }
+
+  size_t size = ALIGNED((size_t)stride * height, BLOCK_ALIGN);
+
+  struct xdwl_shm_block *block = shm_best_fit(allocator, size);
+  if (!block) {
+    if (shm_grow(allocator, size) == -1)
+      return NULL;
+
+    block = shm_best_fit(allocator, size);
+  }
+
+  struct xdwl_shm_buffer *buffer = xdwl_pool_alloc(allocator->buffer_pool);
+  if (!buffer)
+    return NULL;
+
+  buffer->id = xdwl_object_register(allocator->proxy, 0, "wl_buffer");
+  if (buffer->id == 0) {
+    xdwl_pool_free(allocator->buffer_pool, buffer);
+    return NULL;
+  }
+
+  if (xdwl_shm_pool_create_buffer(allocator->proxy, allocator->pool_id,
+                                  buffer->id, block->offset, width, height,
+                                  stride, format) == -1) {
+    if (xdwl_object_unregister(allocator->proxy, buffer->id) == -1)
+      xdwl_error_print();
+    xdwl_pool_free(allocator->buffer_pool, buffer);
+    return NULL;
+  }
+
+  buffer->allocator = allocator;
+  buffer->offset = block->offset;
+  buffer->size = size;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->stride = stride;
+  buffer->format = format;
+  buffer->data = allocator->data + block->offset;
+
+  // carve from the front, the remainder stays in place in the sorted list
+  block->offset += size;
+  block->size -= size;
+  if (block->size == 0) {
+    xdwl_ilist_remove(&allocator->free_blocks, &block->link);
+    xdwl_pool_free(allocator->block_pool, block);
+  }
+
+  xdwl_ilist_push(&allocator->buffers, &buffer->link);
+  return buffer;
+}
+
+void xdwl_shm_buffer_destroy(struct xdwl_shm_buffer *buffer) {
+  struct xdwl_shm_allocator *allocator;
+
+  if (!buffer)
+    return;
+
+  allocator = buffer->allocator;
+
+  if (xdwl_buffer_destroy(allocator->proxy, buffer->id) == -1 ||
+      xdwl_object_unregister(allocator->proxy, buffer->id) == -1)
+    xdwl_error_print();
+
+  xdwl_ilist_remove(&allocator->buffers, &buffer->link);
+  if (shm_free_range(allocator, buffer->offset, buffer->size) == -1)
+    xdwl_error_print();
+
+  xdwl_pool_free(allocator->buffer_pool, buffer);
+}
@@ -0,0 +1,155 @@
+#include "xdwayland-stats.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STATS_SIZE_HINT 32
+
+#define load(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define clear(counter) __atomic_store_n(&(counter), 0, __ATOMIC_RELAXED)
+
+int xdwl_stats_init(xdwl_proxy *proxy) {
+  proxy->stats = NULL;
+  proxy->time_handlers = 0;
+  memset(&proxy->io, 0, sizeof(proxy->io));
+
+  proxy->stats_by_interface =
+      xdwl_map_new_in(STATS_SIZE_HINT, &proxy->accounts[XDWL_ALLOC_STATS]);
+  if (!proxy->stats_by_interface)
+    return -1;
+
+  return 0;
+}
+
+void xdwl_stats_finish(xdwl_proxy *proxy) {
+  struct xdwl_interface_stats *s = proxy->stats, *next;
+
+  for (; s; s = next) {
+    next = s->next;
+    xdwl_free(&proxy->accounts[XDWL_ALLOC_STATS], s,
+              sizeof(struct xdwl_interface_stats));
+  }
+
+  xdwl_map_destroy(proxy->stats_by_interface);
+}
+
+struct xdwl_interface_stats *
+xdwl_stats_lookup(xdwl_proxy *proxy, const struct xdwl_interface *interface) {
+  struct xdwl_interface_stats **s =
+      xdwl_map_get(proxy->stats_by_interface, (size_t)interface);
+  if (s)
+    return *s;
+
+  struct xdwl_interface_stats *stats = xdwl_alloc_zeroed(
+      &proxy->accounts[XDWL_ALLOC_STATS], sizeof(struct xdwl_interface_stats));
+  if (!stats) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_stats_lookup: failed to calloc()");
+    return NULL;
+  }
+
+  stats->interface = interface;
+  stats->next = proxy->stats;
+
+  if (xdwl_map_set(proxy->stats_by_interface, (size_t)interface, &stats,
+                   sizeof(stats)) == NULL) {
+    xdwl_free(&proxy->accounts[XDWL_ALLOC_STATS], stats,
+              sizeof(struct xdwl_interface_stats));
+    return NULL;
+  }
+
+  // readers on other threads see it whole or not at all
+  __atomic_store_n(&proxy->stats, stats, __ATOMIC_RELEASE);
+  return stats;
+}
+
+static void stats_copy(struct xdwl_opcode_stats *dst,
+                       struct xdwl_opcode_stats *src) {
+  for (size_t i = 0; i < XDWL_STATS_MAX_OPCODES; i++) {
+    dst[i].messages = load(src[i].messages);
+    dst[i].bytes = load(src[i].bytes);
+    dst[i].fds = load(src[i].fds);
+    dst[i].handler_ns = load(src[i].handler_ns);
+  }
+}
+
+static void stats_clear(struct xdwl_opcode_stats *opcodes) {
+  for (size_t i = 0; i < XDWL_STATS_MAX_OPCODES; i++) {
+    clear(opcodes[i].messages);
+    clear(opcodes[i].bytes);
+    clear(opcodes[i].fds);
+    clear(opcodes[i].handler_ns);
+  }
+}
+
+int xdwl_proxy_get_stats(xdwl_proxy *proxy, struct xdwl_stats *stats) {
+  struct xdwl_interface_stats *first =
+      __atomic_load_n(&proxy->stats, __ATOMIC_ACQUIRE);
+  size_t count = 0;
+
+  for (struct xdwl_interface_stats *s = first; s; s = s->next)
+    count++;
+
+  stats->interfaces = malloc(count * sizeof(struct xdwl_interface_stats));
+  if (!stats->interfaces && count) {
+    perror("malloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_proxy_get_stats: failed to malloc()");
+    return -1;
+  }
+
+  stats->interface_count = count;
+  stats->io.send_calls = load(proxy->io.send_calls);
+  stats->io.bytes_sent = load(proxy->io.bytes_sent);
+  stats->io.recv_calls = load(proxy->io.recv_calls);
+  stats->io.bytes_received = load(proxy->io.bytes_received);
+
+  for (size_t i = 0; i < XDWL_ALLOC_SUBSYSTEMS; i++) {
+    struct xdwl_alloc_stats *a = &proxy->accounts[i].stats;
+    stats->memory[i].live_bytes = load(a->live_bytes);
+    stats->memory[i].allocations = load(a->allocations);
+    stats->memory[i].frees = load(a->frees);
+  }
+
+  struct xdwl_interface_stats *dst = stats->interfaces;
+  for (struct xdwl_interface_stats *s = first; s; s = s->next, dst++) {
+    dst->next = NULL;
+    dst->interface = s->interface;
+    stats_copy(dst->requests, s->requests);
+    stats_copy(dst->events, s->events);
+  }
+
+  return 0;
+}
+
+void xdwl_proxy_reset_stats(xdwl_proxy *proxy) {
+  struct xdwl_interface_stats *s =
+      __atomic_load_n(&proxy->stats, __ATOMIC_ACQUIRE);
+
+  for (; s; s = s->next) {
+    stats_clear(s->requests);
+    stats_clear(s->events);
+  }
+
+  clear(proxy->io.send_calls);
+  clear(proxy->io.bytes_sent);
+  clear(proxy->io.recv_calls);
+  clear(proxy->io.bytes_received);
+
+  // live bytes is a level, not a rate
+  for (size_t i = 0; i < XDWL_ALLOC_SUBSYSTEMS; i++) {
+    clear(proxy->accounts[i].stats.allocations);
+    clear(proxy->accounts[i].stats.frees);
+  }
+}
+
+void xdwl_proxy_time_handlers(xdwl_proxy *proxy, int enable) {
+  __atomic_store_n(&proxy->time_handlers, enable != 0, __ATOMIC_RELAXED);
+}
+
+void xdwl_stats_release(struct xdwl_stats *stats) {
+  free(stats->interfaces);
+  stats->interfaces = NULL;
+  stats->interface_count = 0;
+}
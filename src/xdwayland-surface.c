@@ -0,0 +1,145 @@
+#include "xdwayland-surface.h"
+#include "xdwayland-core.h"
+#include "xdwayland-private.h"
+
+#include <string.h>
+
+void xdwl_surface_state_init(struct xdwl_surface_state *state,
+                             xdwl_proxy *proxy, xdwl_id wl_surface_id) {
+  memset(state, 0, sizeof(struct xdwl_surface_state));
+
+  state->proxy = proxy;
+  state->surface_id = wl_surface_id;
+
+  // what the compositor assumes for a surface nobody has configured yet
+  state->current.scale = 1;
+  state->current.transform = 0;
+  state->pending = state->current;
+
+  xdwl_damage_init(&state->damage, 0);
+}
+
+void xdwl_surface_state_attach(struct xdwl_surface_state *state,
+                               xdwl_id wl_buffer_id) {
+  state->pending.buffer = wl_buffer_id;
+  state->pending_fields |= XDWL_SURFACE_BUFFER;
+}
+
+void xdwl_surface_state_set_offset(struct xdwl_surface_state *state,
+                                   int32_t x, int32_t y) {
+  state->pending.offset_x = x;
+  state->pending.offset_y = y;
+  state->pending_fields |= XDWL_SURFACE_OFFSET;
+}
+
+void xdwl_surface_state_set_scale(struct xdwl_surface_state *state,
+                                  int32_t scale) {
+  state->pending.scale = scale;
+  state->pending_fields |= XDWL_SURFACE_SCALE;
+}
+
+void xdwl_surface_state_set_transform(struct xdwl_surface_state *state,
+                                      int32_t transform) {
+  state->pending.transform = transform;
+  state->pending_fields |= XDWL_SURFACE_TRANSFORM;
+}
+
+static uint32_t surface_region_seq(xdwl_proxy *proxy, xdwl_id wl_region_id) {
+  xdwl_object *region =
+      wl_region_id ? xdwl_object_get_by_id(proxy, wl_region_id) : NULL;
+
+  return region ? region->seq : 0;
+}
+
+void xdwl_surface_state_set_opaque_region(struct xdwl_surface_state *state,
+                                          xdwl_id wl_region_id) {
+  state->pending.opaque_region = wl_region_id;
+  state->pending.opaque_region_seq =
+      surface_region_seq(state->proxy, wl_region_id);
+  state->pending_fields |= XDWL_SURFACE_OPAQUE_REGION;
+}
+
+void xdwl_surface_state_set_input_region(struct xdwl_surface_state *state,
+                                         xdwl_id wl_region_id) {
+  state->pending.input_region = wl_region_id;
+  state->pending.input_region_seq =
+      surface_region_seq(state->proxy, wl_region_id);
+  state->pending_fields |= XDWL_SURFACE_INPUT_REGION;
+}
+
+void xdwl_surface_state_damage(struct xdwl_surface_state *state, int32_t x,
+                               int32_t y, int32_t width, int32_t height) {
+  xdwl_damage_add(&state->damage, x, y, width, height);
+}
+
+// a field goes out if it was set and, apart from the buffer, changed
+static int surface_field_dirty(struct xdwl_surface_state *state,
+                               uint32_t field, int changed) {
+  if (!(state->pending_fields & field))
+    return 0;
+
+  if (!changed) {
+    state->requests_elided++;
+    return 0;
+  }
+
+  state->requests_sent++;
+  return 1;
+}
+
+int xdwl_surface_state_commit(struct xdwl_surface_state *state) {
+  struct xdwl_surface_values *pending = &state->pending;
+  struct xdwl_surface_values *current = &state->current;
+  xdwl_proxy *proxy = state->proxy;
+  xdwl_id surface = state->surface_id;
+
+  if (surface_field_dirty(state, XDWL_SURFACE_BUFFER, 1) &&
+      xdwl_surface_attach(proxy, surface, pending->buffer, 0, 0) == -1)
+    return -1;
+
+  // offsets are relative to the previous buffer and don't persist
+  if (surface_field_dirty(state, XDWL_SURFACE_OFFSET,
+                          pending->offset_x || pending->offset_y) &&
+      xdwl_surface_offset(proxy, surface, pending->offset_x,
+                          pending->offset_y) == -1)
+    return -1;
+
+  if (surface_field_dirty(state, XDWL_SURFACE_SCALE,
+                          pending->scale != current->scale) &&
+      xdwl_surface_set_buffer_scale(proxy, surface, pending->scale) == -1)
+    return -1;
+
+  if (surface_field_dirty(state, XDWL_SURFACE_TRANSFORM,
+                          pending->transform != current->transform) &&
+      xdwl_surface_set_buffer_transform(proxy, surface, pending->transform) ==
+          -1)
+    return -1;
+
+  if (surface_field_dirty(state, XDWL_SURFACE_OPAQUE_REGION,
+                          pending->opaque_region != current->opaque_region ||
+                              pending->opaque_region_seq !=
+                                  current->opaque_region_seq) &&
+      xdwl_surface_set_opaque_region(proxy, surface, pending->opaque_region) ==
+          -1)
+    return -1;
+
+  if (surface_field_dirty(state, XDWL_SURFACE_INPUT_REGION,
+                          pending->input_region != current->input_region ||
+                              pending->input_region_seq !=
+                                  current->input_region_seq) &&
+      xdwl_surface_set_input_region(proxy, surface, pending->input_region) ==
+          -1)
+    return -1;
+
+  state->requests_sent += state->damage.count;
+  if (xdwl_damage_commit(proxy, surface, &state->damage) == -1)
+    return -1;
+  state->requests_sent++;
+
+  pending->offset_x = 0;
+  pending->offset_y = 0;
+  *current = *pending;
+  state->pending_fields = 0;
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+#include "xdwayland-swapchain.h"
+#include "xdwayland-core.h"
+#include "xdwayland-pixman.h"
+#include "xdwayland-private.h"
+
+#include <stdlib.h>
+
+// only 32 bits per pixel formats are handed out
+#define BYTES_PER_PIXEL 4
+
+static void swapchain_buffer_release(void *user_data, xdwl_arg *args) {
+  struct xdwl_swapchain_buffer *buffer = user_data;
+
+  buffer->busy = 0;
+}
+
+static int swapchain_buffer_create(struct xdwl_swapchain *swapchain,
+                                   struct xdwl_swapchain_buffer *buffer) {
+  struct xdwl_buffer_event_handlers handlers = {
+      .release = swapchain_buffer_release,
+  };
+
+  buffer->shm = xdwl_shm_buffer_create(
+      swapchain->allocator, swapchain->width, swapchain->height,
+      swapchain->width * BYTES_PER_PIXEL, swapchain->format);
+  if (!buffer->shm)
+    return -1;
+
+  // the buffer was registered last, so the listener lands on it
+  if (xdwl_buffer_add_listener(swapchain->allocator->proxy, &handlers,
+                               buffer) == -1) {
+    xdwl_shm_buffer_destroy(buffer->shm);
+    buffer->shm = NULL;
+    return -1;
+  }
+
+  buffer->busy = 0;
+  buffer->last_used = 0;
+  buffer->age = 0;
+
+  return 0;
+}
+
+// the union of every frame submitted since buffer was last shown, or all of
+// it when the contents are undefined or too old for the history
+static void swapchain_buffer_damage(struct xdwl_swapchain *swapchain,
+                                    struct xdwl_swapchain_buffer *buffer) {
+  struct xdwl_damage *damage = &buffer->damage;
+
+  xdwl_damage_init(damage, 0);
+
+  if (buffer->age == 0 || buffer->age - 1 > XDWL_SWAPCHAIN_HISTORY) {
+    xdwl_damage_add(damage, 0, 0, buffer->shm->width, buffer->shm->height);
+    return;
+  }
+
+  for (uint64_t frame = buffer->last_used + 1; frame <= swapchain->frame;
+       frame++)
+    xdwl_damage_add_damage(
+        damage, &swapchain->history[frame % XDWL_SWAPCHAIN_HISTORY]);
+}
+
+static void swapchain_buffer_destroy(struct xdwl_swapchain_buffer *buffer) {
+  xdwl_shm_buffer_destroy(buffer->shm);
+  buffer->shm = NULL;
+  buffer->busy = 0;
+  buffer->last_used = 0;
+}
+
+struct xdwl_swapchain *
+xdwl_swapchain_create(struct xdwl_shm_allocator *allocator,
+                      size_t buffer_count, int32_t width, int32_t height,
+                      uint32_t format) {
+  if (buffer_count == 0 || buffer_count > XDWL_SWAPCHAIN_MAX_BUFFERS) {
+    xdwl_error_set(XDWLERR_OUTOFRANGE,
+                   "xdwl_swapchain_create: buffer count must be 1..%d, got %ld",
+                   XDWL_SWAPCHAIN_MAX_BUFFERS, buffer_count);
+    return NULL;
+  }
+
+  struct xdwl_swapchain *swapchain = calloc(1, sizeof(struct xdwl_swapchain));
+  if (!swapchain) {
+    perror("calloc");
+    xdwl_error_set(XDWLERR_STD, "xdwl_swapchain_create: failed to calloc()");
+    return NULL;
+  }
+
+  swapchain->allocator = allocator;
+  swapchain->width = width;
+  swapchain->height = height;
+  swapchain->format = format;
+  swapchain->buffer_count = buffer_count;
+
+  // buffers are created on demand by acquire, so a client that is never
+  // starved only pays for the buffers it actually cycles through
+  for (size_t i = 0; i < buffer_count; i++)
+    swapchain->buffers[i].swapchain = swapchain;
+
+  return swapchain;
+}
+
+void xdwl_swapchain_destroy(struct xdwl_swapchain *swapchain) {
+  if (!swapchain)
+    return;
+
+  for (size_t i = 0; i < swapchain->buffer_count; i++) {
+    if (swapchain->buffers[i].shm)
+      swapchain_buffer_destroy(&swapchain->buffers[i]);
+  }
+
+  free(swapchain);
+}
+
+void xdwl_swapchain_resize(struct xdwl_swapchain *swapchain, int32_t width,
+                           int32_t height) {
+  if (swapchain->width == width && swapchain->height == height)
+    return;
+
+  swapchain->width = width;
+  swapchain->height = height;
+
+  // busy buffers are still read by the compositor, acquire replaces them
+  // once they are released
+  for (size_t i = 0; i < swapchain->buffer_count; i++) {
+    struct xdwl_swapchain_buffer *buffer = &swapchain->buffers[i];
+    if (buffer->shm && !buffer->busy)
+      swapchain_buffer_destroy(buffer);
+  }
+}
+
+struct xdwl_swapchain_buffer *
+xdwl_swapchain_acquire(struct xdwl_swapchain *swapchain) {
+  struct xdwl_swapchain_buffer *oldest = NULL;
+  struct xdwl_swapchain_buffer *empty = NULL;
+
+  for (size_t i = 0; i < swapchain->buffer_count; i++) {
+    struct xdwl_swapchain_buffer *buffer = &swapchain->buffers[i];
+
+    if (!buffer->shm) {
+      if (!empty)
+        empty = buffer;
+      continue;
+    }
+
+    if (buffer->busy)
+      continue;
+
+    if (!oldest || buffer->last_used < oldest->last_used)
+      oldest = buffer;
+  }
+
+  if (oldest && (oldest->shm->width != swapchain->width ||
+                 oldest->shm->height != swapchain->height)) {
+    swapchain_buffer_destroy(oldest);
+    empty = oldest;
+    oldest = NULL;
+  }
+
+  if (!oldest) {
+    if (!empty) {
+      xdwl_error_set(XDWLERR_NOBUFFER,
+                     "xdwl_swapchain_acquire: all %ld buffers are busy",
+                     swapchain->buffer_count);
+      return NULL;
+    }
+
+    if (swapchain_buffer_create(swapchain, empty) == -1)
+      return NULL;
+
+    oldest = empty;
+  }
+
+  if (oldest->last_used)
+    oldest->age = swapchain->frame - oldest->last_used + 1;
+  else
+    oldest->age = 0;
+
+  swapchain_buffer_damage(swapchain, oldest);
+  return oldest;
+}
+
+void xdwl_swapchain_submit(struct xdwl_swapchain *swapchain,
+                           struct xdwl_swapchain_buffer *buffer,
+                           const struct xdwl_damage *damage) {
+  buffer->busy = 1;
+  buffer->last_used = ++swapchain->frame;
+
+  struct xdwl_damage *entry =
+      &swapchain->history[swapchain->frame % XDWL_SWAPCHAIN_HISTORY];
+  xdwl_damage_init(entry, 0);
+
+  if (damage)
+    xdwl_damage_add_damage(entry, damage);
+  else
+    xdwl_damage_add(entry, 0, 0, buffer->shm->width, buffer->shm->height);
+}
+
+void xdwl_swapchain_copy_forward(struct xdwl_swapchain *swapchain,
+                                 struct xdwl_swapchain_buffer *buffer) {
+  struct xdwl_swapchain_buffer *newest = NULL;
+
+  if (buffer->damage.count == 0 || swapchain->frame == 0)
+    return;
+
+  for (size_t i = 0; i < swapchain->buffer_count; i++) {
+    if (swapchain->buffers[i].shm &&
+        swapchain->buffers[i].last_used == swapchain->frame) {
+      newest = &swapchain->buffers[i];
+      break;
+    }
+  }
+
+  if (!newest || newest == buffer ||
+      newest->shm->width != buffer->shm->width ||
+      newest->shm->height != buffer->shm->height)
+    return;
+
+  struct xdwl_image src = {newest->shm->data, newest->shm->width,
+                           newest->shm->height, newest->shm->stride,
+                           newest->shm->format};
+  struct xdwl_image dst = {buffer->shm->data, buffer->shm->width,
+                           buffer->shm->height, buffer->shm->stride,
+                           buffer->shm->format};
+
+  // the compositor only reads newest, copying out of it while it's busy is
+  // fine
+  for (size_t i = 0; i < buffer->damage.count; i++) {
+    struct xdwl_rect *r = &buffer->damage.rects[i];
+    xdwl_pixman_copy(&dst, r->x, r->y, &src, *r);
+  }
+
+  xdwl_damage_clear(&buffer->damage);
+}
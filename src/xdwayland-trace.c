@@ -0,0 +1,333 @@
+#include "xdwayland-trace.h"
+#include "xdwayland-client.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-private.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_SLOTS 1024 // power of two
+#define TRACE_TEXT_SIZE 496
+#define TRACE_BATCH_SIZE (1 << 16)
+
+// a bounded multi-producer queue: a slot is free to write at position pos
+// when its seq is pos and readable once the producer sets it to pos + 1.
+// the writer hands it back for the next lap with pos + TRACE_SLOTS
+struct trace_slot {
+  uint64_t seq;
+  struct timespec time;
+  uint32_t length;
+  char text[TRACE_TEXT_SIZE];
+};
+
+int xdwl_trace_on = 0;
+
+static struct trace_slot *slots;
+static uint64_t head; // next position producers claim
+static uint64_t tail; // next position the writer reads
+static uint64_t written; // everything before it reached output_fd
+static uint64_t dropped;
+static int output_fd = STDERR_FILENO;
+
+static const char *filters[XDWL_TRACE_MAX_FILTERS];
+static size_t filter_count;
+
+static pthread_once_t writer_once = PTHREAD_ONCE_INIT;
+static int writer_started;
+
+// the writer sleeps on wake while the queue is empty. it sets asleep
+// before its last look at the queue and producers check it after
+// publishing, all sequentially consistent so one of them sees the other
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int asleep;
+
+static size_t trace_append(char *text, size_t length, const char *format,
+                           ...) {
+  va_list args;
+
+  if (length >= TRACE_TEXT_SIZE)
+    return length;
+
+  va_start(args, format);
+  int n = vsnprintf(text + length, TRACE_TEXT_SIZE - length, format, args);
+  va_end(args);
+
+  return n < 0 ? length : length + n;
+}
+
+static size_t trace_format_args(char *text, size_t length, xdwl_arg *args,
+                                const char *signature) {
+  size_t arg_count = signature ? strlen(signature) : 0;
+
+  length = trace_append(text, length, "(");
+
+  for (size_t i = 0; i < arg_count; i++) {
+    const char *separator = i ? ", " : "";
+
+    switch (signature[i]) {
+    case 'i':
+      length = trace_append(text, length, "%s%d", separator, args[i].i);
+      break;
+    case 'u':
+      length = trace_append(text, length, "%s%u", separator, args[i].u);
+      break;
+    case 'f':
+      length = trace_append(text, length, "%s%f", separator, args[i].f);
+      break;
+    case 's':
+      length = trace_append(text, length, "%s\"%s\"", separator, args[i].s);
+      break;
+    case 'h':
+      length = trace_append(text, length, "%sfd %d", separator, args[i].fd);
+      break;
+    }
+  }
+
+  return trace_append(text, length, ")\n");
+}
+
+static int trace_filtered(const char *interface_name) {
+  size_t count = __atomic_load_n(&filter_count, __ATOMIC_ACQUIRE);
+
+  if (count == 0)
+    return 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (__atomic_load_n(&filters[i], __ATOMIC_RELAXED) == interface_name)
+      return 0;
+  }
+
+  return 1;
+}
+
+void xdwl_trace_message(const char *direction, const xdwl_object *object,
+                        const struct xdwl_method *method, xdwl_arg *args) {
+  if (!slots || trace_filtered(object->name))
+    return;
+
+  uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+  struct trace_slot *slot;
+
+  for (;;) {
+    slot = &slots[pos & (TRACE_SLOTS - 1)];
+    int64_t diff =
+        (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0) {
+      // the writer is a whole lap behind
+      __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    }
+  }
+
+  clock_gettime(CLOCK_REALTIME, &slot->time);
+
+  size_t length = trace_append(slot->text, 0, "%s %s.#%u.%s", direction,
+                               object->name, object->id, method->name);
+  length = trace_format_args(slot->text, length, args, method->signature);
+
+  // cut off, still end the line
+  if (length >= TRACE_TEXT_SIZE) {
+    length = TRACE_TEXT_SIZE - 1;
+    slot->text[length - 1] = '\n';
+  }
+  slot->length = length;
+
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&asleep, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&wake_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+  }
+}
+
+static void trace_write(char *batch, size_t length) {
+  size_t written = 0;
+
+  while (written < length) {
+    ssize_t n = write(output_fd, batch + written, length - written);
+    if (n <= 0)
+      return;
+    written += n;
+  }
+}
+
+// writes out whatever is readable, returns how many messages that was
+static size_t trace_drain(char *batch) {
+  size_t count = 0, length = 0;
+
+  for (;;) {
+    struct trace_slot *slot = &slots[tail & (TRACE_SLOTS - 1)];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+      break;
+
+    if (length + slot->length + 64 > TRACE_BATCH_SIZE) {
+      trace_write(batch, length);
+      __atomic_store_n(&written, tail, __ATOMIC_RELEASE);
+      length = 0;
+    }
+
+    struct tm tm;
+    localtime_r(&slot->time.tv_sec, &tm);
+    length += strftime(batch + length, 32, "[xdwayland %H:%M:%S", &tm);
+    length += sprintf(batch + length, ".%06ld] ", slot->time.tv_nsec / 1000);
+    memcpy(batch + length, slot->text, slot->length);
+    length += slot->length;
+
+    __atomic_store_n(&slot->seq, tail + TRACE_SLOTS, __ATOMIC_RELEASE);
+    __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+    count++;
+  }
+
+  if (length) {
+    trace_write(batch, length);
+    __atomic_store_n(&written, tail, __ATOMIC_RELEASE);
+  }
+
+  return count;
+}
+
+static int trace_readable() {
+  struct trace_slot *slot = &slots[tail & (TRACE_SLOTS - 1)];
+
+  return __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == tail + 1;
+}
+
+static void *trace_writer(void *data) {
+  static char batch[TRACE_BATCH_SIZE];
+
+  for (;;) {
+    if (trace_drain(batch) > 0)
+      continue;
+
+    // the lock is held from setting asleep until the wait releases it, so
+    // a producer that saw it can't signal too early
+    pthread_mutex_lock(&wake_lock);
+    __atomic_store_n(&asleep, 1, __ATOMIC_SEQ_CST);
+
+    while (!trace_readable())
+      pthread_cond_wait(&wake, &wake_lock);
+
+    __atomic_store_n(&asleep, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&wake_lock);
+  }
+
+  return NULL;
+}
+
+static void trace_exit() { xdwl_trace_flush(); }
+
+static void trace_start() {
+  pthread_t thread;
+
+  slots = malloc(TRACE_SLOTS * sizeof(struct trace_slot));
+  if (!slots) {
+    perror("malloc");
+    return;
+  }
+
+  for (size_t i = 0; i < TRACE_SLOTS; i++)
+    slots[i].seq = i;
+
+  if (pthread_create(&thread, NULL, trace_writer, NULL) != 0) {
+    perror("pthread_create");
+    free(slots);
+    slots = NULL;
+    return;
+  }
+
+  pthread_detach(thread);
+  atexit(trace_exit);
+  writer_started = 1;
+}
+
+void xdwl_trace_enable(int enable) {
+  if (enable) {
+    pthread_once(&writer_once, trace_start);
+    if (!writer_started)
+      return;
+  }
+
+  __atomic_store_n(&xdwl_trace_on, enable != 0, __ATOMIC_RELEASE);
+}
+
+int xdwl_trace_set_filter(const char *interfaces) {
+  const char *interned[XDWL_TRACE_MAX_FILTERS];
+  size_t count = 0;
+
+  while (interfaces && *interfaces) {
+    size_t length = strcspn(interfaces, ",");
+
+    if (length > 0) {
+      if (count == XDWL_TRACE_MAX_FILTERS) {
+        xdwl_error_set(XDWLERR_OUTOFRANGE,
+                       "xdwl_trace_set_filter: more than %d interfaces",
+                       XDWL_TRACE_MAX_FILTERS);
+        return -1;
+      }
+
+      char name[length + 1];
+      memcpy(name, interfaces, length);
+      name[length] = '\0';
+
+      if ((interned[count++] = xdwl_intern(name)) == NULL)
+        return -1;
+    }
+
+    interfaces += length;
+    if (*interfaces == ',')
+      interfaces++;
+  }
+
+  // messages traced while this runs may slip through unfiltered
+  __atomic_store_n(&filter_count, 0, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < count; i++)
+    __atomic_store_n(&filters[i], interned[i], __ATOMIC_RELAXED);
+  __atomic_store_n(&filter_count, count, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+void xdwl_trace_set_output(int fd) { output_fd = fd; }
+
+void xdwl_trace_flush() {
+  struct timespec wait = {0, 100000};
+
+  if (!slots)
+    return;
+
+  uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n(&written, __ATOMIC_ACQUIRE) < end)
+    nanosleep(&wait, NULL);
+}
+
+uint64_t xdwl_trace_get_dropped() {
+  return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+__attribute__((constructor)) static void trace_from_env() {
+  const char *debug = getenv("XDWL_DEBUG");
+
+  if (!debug || !*debug || strcmp(debug, "0") == 0)
+    return;
+
+  if (strcmp(debug, "1") != 0 && xdwl_trace_set_filter(debug) == -1) {
+    xdwl_error_print();
+    return;
+  }
+
+  xdwl_trace_enable(1);
+}
@@ -1,11 +1,9 @@
 #include "xdwayland-private.h"
 #include "xdwayland-types.h"
 
-#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
-#include <time.h>
 
 #define CAP 4096
 #define PADDED4(n) ((n + 4) & ~3)
@@ -22,59 +20,6 @@ void print_buffer(char *buffer, size_t buffer_len) {
   printf("\n");
 }
 
-void xdwl_log(const char *level, const char *message, ...) {
-  va_list args;
-  time_t t;
-  struct tm *tt;
-  char timestamp_string[10];
-
-  t = time(NULL);
-  tt = localtime(&t);
-
-  strftime(timestamp_string, sizeof(timestamp_string), "%H:%M:%S", tt);
-
-  va_start(args, message);
-  printf("[libxdwayland %s %s] ", timestamp_string, level);
-  vprintf(message, args);
-
-  va_end(args);
-  fflush(stdout);
-}
-
-void xdwl_show_args(xdwl_arg *args, char *signature) {
-  size_t argc = strlen(signature);
-  printf("(");
-
-  for (size_t i = 0; i < argc; i++) {
-    char arg_type = signature[i];
-    switch (arg_type) {
-    case 'i':
-      printf("%d", args[i].i);
-      break;
-    case 'u':
-      printf("%u", args[i].u);
-      break;
-    case 'f':
-      printf("%f", args[i].f);
-      break;
-
-    case 's':
-      printf("\"%s\"", args[i].s);
-      break;
-
-    case 'h':
-      printf("%d", args[i].fd);
-      break;
-    }
-    if (i != argc - 1) {
-      printf(", ");
-    }
-  }
-
-  printf(")\n");
-  fflush(stdout);
-}
-
 int xdwl_read_args(struct xdwl_raw_message *message, xdwl_arg *args,
                    const char *signature) {
   size_t arg_count = strlen(signature);
@@ -93,9 +38,9 @@ int xdwl_read_args(struct xdwl_raw_message *message, xdwl_arg *args,
       offset += sizeof(uint32_t);
       break;
 
-    case 'f':
-      args[i].f = *(double *)(message->body + offset);
-      offset += sizeof(double);
+    case 'f': // wl_fixed_t, 24.8 fixed point
+      args[i].f = *(int32_t *)(message->body + offset) / 256.0;
+      offset += sizeof(int32_t);
       break;
 
     case 's':
@@ -138,8 +83,8 @@ void xdwl_write_args(char *buffer, size_t *offset, xdwl_arg *args,
       break;
 
     case 'f':
-      *(float *)(buffer + *offset) = arg.f;
-      *offset += sizeof(float);
+      *(int32_t *)(buffer + *offset) = (int32_t)(arg.f * 256.0);
+      *offset += sizeof(int32_t);
       break;
 
     case 's':
@@ -198,8 +143,9 @@ uint16_t xdwl_calculate_body_size(xdwl_arg *args, size_t arg_count,
       break;
 
     case 's':
+      // the terminator is already counted in, like in xdwl_write_args
       body_size += sizeof(uint32_t);
-      body_size += PADDED4(strlen(arg.s) + 1);
+      body_size += PADDED4(strlen(arg.s));
       break;
     }
   };
@@ -0,0 +1,540 @@
+#include "xdwayland-capture.h"
+#include "xdwayland-client.h"
+#include "xdwayland-collections.h"
+#include "xdwayland-private.h"
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 8
+#define MAX_ARGS 32
+#define HISTOGRAM_BUCKETS 32
+#define DEFAULT_TOP 10
+#define READ_BUFFER_SIZE (1 << 20)
+
+struct opcode_stats {
+  uint64_t messages;
+  uint64_t bytes;
+  uint32_t max_size;
+};
+
+struct interface_stats {
+  const struct xdwl_interface *interface;
+  struct opcode_stats *opcodes; // requests, then events
+};
+
+struct message_info {
+  uint64_t time_ns;
+  uint32_t size;
+  uint8_t direction;
+  xdwl_id object_id;
+  const struct xdwl_interface *interface; // NULL if it was unknown
+  uint16_t opcode;
+};
+
+// bytes of one direction waiting for the rest of a message, records split
+// them wherever the socket did
+struct stream {
+  char buffer[2 * XDWL_CAPTURE_MAX_RECORD];
+  size_t length;
+  uint64_t messages;
+  uint64_t bytes;
+  uint64_t last_ns;
+  uint64_t histogram[HISTOGRAM_BUCKETS]; // inter-arrival, log2 us
+};
+
+struct decoder {
+  xdwl_map *objects; // id to interface
+  xdwl_map *stats;   // interface to struct interface_stats
+  struct stream streams[2];
+
+  struct message_info *largest; // biggest first
+  size_t largest_count;
+  size_t top;
+
+  int quiet;
+  uint64_t previous_ns;
+  uint64_t unknown;
+  uint64_t records;
+};
+
+static const char *directions[] = {"->", "<-"};
+
+static const struct xdwl_interface *interface_named(const char *name) {
+  return xdwl_interface_lookup(xdwl_intern_lookup(name));
+}
+
+static void object_set(struct decoder *d, xdwl_id id,
+                       const struct xdwl_interface *interface) {
+  if (!interface) {
+    xdwl_map_remove(d->objects, id);
+    return;
+  }
+
+  if (xdwl_map_set(d->objects, id, &interface, sizeof(interface)) == NULL)
+    xdwl_error_print();
+}
+
+static const struct xdwl_interface *object_get(struct decoder *d,
+                                               xdwl_id id) {
+  const struct xdwl_interface **interface = xdwl_map_get(d->objects, id);
+  return interface ? *interface : NULL;
+}
+
+// bounds checked unlike xdwl_read_args, a capture may be cut off or not
+// match the tables it's decoded with. args[0] is the first argument
+static int decode_args(const char *body, size_t length, const char *signature,
+                       xdwl_arg *args) {
+  size_t offset = 0;
+
+  for (size_t i = 0; signature && signature[i] && i < MAX_ARGS; i++) {
+    uint32_t string_length;
+
+    if (signature[i] == 'h') {
+      args[i].fd = -1;
+      continue;
+    }
+
+    if (offset + sizeof(uint32_t) > length)
+      return -1;
+
+    switch (signature[i]) {
+    case 'i':
+      args[i].i = *(int32_t *)(body + offset);
+      break;
+    case 'u':
+      args[i].u = *(uint32_t *)(body + offset);
+      break;
+    case 'f':
+      args[i].f = *(int32_t *)(body + offset) / 256.0;
+      break;
+    case 's':
+      string_length = *(uint32_t *)(body + offset);
+      offset += sizeof(uint32_t);
+
+      if (string_length == 0 || string_length > length - offset ||
+          body[offset + string_length - 1] != '\0')
+        return -1;
+
+      args[i].s = (char *)(body + offset);
+      offset += (string_length + 3) & ~3u;
+      continue;
+    }
+
+    offset += sizeof(uint32_t);
+  }
+
+  return 0;
+}
+
+static void print_args(const xdwl_arg *args, const char *signature) {
+  putchar('(');
+
+  for (size_t i = 0; signature && signature[i] && i < MAX_ARGS; i++) {
+    if (i)
+      fputs(", ", stdout);
+
+    switch (signature[i]) {
+    case 'i':
+      printf("%d", args[i].i);
+      break;
+    case 'u':
+      printf("%u", args[i].u);
+      break;
+    case 'f':
+      printf("%f", args[i].f);
+      break;
+    case 's':
+      printf("\"%s\"", args[i].s);
+      break;
+    case 'h':
+      fputs("fd", stdout);
+      break;
+    }
+  }
+
+  puts(")");
+}
+
+// follows object creation and deletion so later messages can be named
+static void track_objects(struct decoder *d,
+                          const struct xdwl_interface *interface,
+                          const struct xdwl_method *method,
+                          const xdwl_arg *args) {
+  if (method->new_interface) {
+    object_set(d, args[method->new_id_index].u,
+               interface_named(method->new_interface));
+  } else if (strcmp(interface->name, "wl_registry") == 0 &&
+             strcmp(method->name, "bind") == 0) {
+    object_set(d, args[3].u, interface_named(args[1].s));
+  } else if (strcmp(interface->name, "wl_display") == 0 &&
+             strcmp(method->name, "delete_id") == 0) {
+    object_set(d, args[0].u, NULL);
+  }
+}
+
+static void count_message(struct decoder *d, const struct message_info *info) {
+  if (info->interface) {
+    struct interface_stats *s = xdwl_map_get(d->stats, (size_t)info->interface);
+
+    if (!s) {
+      struct interface_stats new_stats = {
+          info->interface,
+          calloc(info->interface->request_count +
+                     info->interface->event_count,
+                 sizeof(struct opcode_stats))};
+
+      if (!new_stats.opcodes) {
+        perror("calloc");
+        return;
+      }
+
+      s = xdwl_map_set(d->stats, (size_t)info->interface, &new_stats,
+                       sizeof(new_stats));
+      if (!s) {
+        free(new_stats.opcodes);
+        return;
+      }
+    }
+
+    size_t index = info->opcode;
+    if (info->direction == XDWL_CAPTURE_RECEIVED)
+      index += info->interface->request_count;
+
+    struct opcode_stats *o = &s->opcodes[index];
+    o->messages++;
+    o->bytes += info->size;
+    if (info->size > o->max_size)
+      o->max_size = info->size;
+  }
+
+  // insertion into a short sorted array, most messages don't make it
+  size_t i = d->largest_count;
+  if (i == d->top && (i == 0 || d->largest[i - 1].size >= info->size))
+    return;
+  if (i == d->top)
+    i--;
+  else
+    d->largest_count++;
+
+  for (; i > 0 && d->largest[i - 1].size < info->size; i--)
+    d->largest[i] = d->largest[i - 1];
+  d->largest[i] = *info;
+}
+
+static void decode_message(struct decoder *d, struct stream *stream,
+                           uint8_t direction, uint64_t time_ns,
+                           const char *message, uint16_t size) {
+  xdwl_arg args[MAX_ARGS];
+  struct message_info info = {time_ns, size, direction, 0, NULL, 0};
+
+  info.object_id = *(uint32_t *)message;
+  info.opcode = *(uint16_t *)(message + 4);
+
+  const struct xdwl_interface *interface = object_get(d, info.object_id);
+  const struct xdwl_method *method = NULL;
+
+  if (interface) {
+    size_t count = direction == XDWL_CAPTURE_SENT ? interface->request_count
+                                                  : interface->event_count;
+    if (info.opcode < count) {
+      method = direction == XDWL_CAPTURE_SENT
+                   ? &interface->requests[info.opcode]
+                   : &interface->events[info.opcode];
+      info.interface = interface;
+    }
+  }
+
+  if (stream->messages) {
+    uint64_t us = (time_ns - stream->last_ns) / 1000;
+    size_t bucket = us ? 63 - __builtin_clzll(us) : 0;
+    if (bucket >= HISTOGRAM_BUCKETS)
+      bucket = HISTOGRAM_BUCKETS - 1;
+    stream->histogram[bucket]++;
+  }
+  stream->last_ns = time_ns;
+  stream->messages++;
+  stream->bytes += size;
+
+  if (!method ||
+      decode_args(message + HEADER_SIZE, size - HEADER_SIZE, method->signature,
+                  args) == -1) {
+    d->unknown++;
+    if (!d->quiet)
+      printf("%12.6f +%.6f %s %s#%u.%u ? (%u bytes)\n", time_ns / 1e9,
+             (time_ns - d->previous_ns) / 1e9, directions[direction],
+             interface ? interface->name : "", info.object_id, info.opcode,
+             size);
+    d->previous_ns = time_ns;
+    count_message(d, &info);
+    return;
+  }
+
+  if (!d->quiet) {
+    printf("%12.6f +%.6f %s %s#%u.%s", time_ns / 1e9,
+           (time_ns - d->previous_ns) / 1e9, directions[direction],
+           interface->name, info.object_id, method->name);
+    print_args(args, method->signature);
+  }
+  d->previous_ns = time_ns;
+
+  track_objects(d, interface, method, args);
+  count_message(d, &info);
+}
+
+static int decode_record(struct decoder *d,
+                         const struct xdwl_capture_record *record,
+                         const char *payload) {
+  if (record->direction > XDWL_CAPTURE_RECEIVED) {
+    fprintf(stderr, "record %lu: bad direction %d\n", d->records,
+            record->direction);
+    return -1;
+  }
+
+  struct stream *stream = &d->streams[record->direction];
+  memcpy(stream->buffer + stream->length, payload, record->length);
+  stream->length += record->length;
+
+  size_t offset = 0;
+  while (stream->length - offset >= HEADER_SIZE) {
+    uint16_t size = *(uint16_t *)(stream->buffer + offset + 6);
+
+    // can't find the next header after this, start over with the next
+    // record
+    if (size < HEADER_SIZE) {
+      fprintf(stderr, "record %lu: malformed message of %u bytes\n",
+              d->records, size);
+      stream->length = 0;
+      return 0;
+    }
+
+    if (size > stream->length - offset)
+      break;
+
+    decode_message(d, stream, record->direction, record->time_ns,
+                   stream->buffer + offset, size);
+    offset += size;
+  }
+
+  memmove(stream->buffer, stream->buffer + offset, stream->length - offset);
+  stream->length -= offset;
+  d->records++;
+
+  return 0;
+}
+
+struct hot_opcode {
+  const struct xdwl_interface *interface;
+  uint8_t direction;
+  uint16_t opcode;
+  struct opcode_stats stats;
+};
+
+static int compare_hot(const void *a, const void *b) {
+  const struct hot_opcode *x = a, *y = b;
+  return (x->stats.messages < y->stats.messages) -
+         (x->stats.messages > y->stats.messages);
+}
+
+static void print_hottest(struct decoder *d) {
+  struct xdwl_map_pair *p;
+  size_t count = 0, n = 0;
+
+  xdwl_map_for_each(d->stats, p) {
+    struct interface_stats *s = (struct interface_stats *)p->value;
+    count += s->interface->request_count + s->interface->event_count;
+  }
+
+  struct hot_opcode *hot = malloc(count * sizeof(struct hot_opcode));
+  if (!hot && count) {
+    perror("malloc");
+    return;
+  }
+
+  xdwl_map_for_each(d->stats, p) {
+    struct interface_stats *s = (struct interface_stats *)p->value;
+    size_t requests = s->interface->request_count;
+
+    for (size_t i = 0; i < requests + s->interface->event_count; i++) {
+      if (s->opcodes[i].messages == 0)
+        continue;
+
+      hot[n].interface = s->interface;
+      hot[n].direction =
+          i < requests ? XDWL_CAPTURE_SENT : XDWL_CAPTURE_RECEIVED;
+      hot[n].opcode = i < requests ? i : i - requests;
+      hot[n].stats = s->opcodes[i];
+      n++;
+    }
+  }
+
+  qsort(hot, n, sizeof(struct hot_opcode), compare_hot);
+
+  printf("\nhottest opcodes:\n");
+  printf("  %12s %14s %8s\n", "messages", "bytes", "max");
+  for (size_t i = 0; i < n && i < d->top; i++) {
+    const struct xdwl_method *method =
+        hot[i].direction == XDWL_CAPTURE_SENT
+            ? &hot[i].interface->requests[hot[i].opcode]
+            : &hot[i].interface->events[hot[i].opcode];
+
+    printf("  %12lu %14lu %8u %s %s.%s\n", hot[i].stats.messages,
+           hot[i].stats.bytes, hot[i].stats.max_size,
+           directions[hot[i].direction], hot[i].interface->name, method->name);
+  }
+
+  free(hot);
+}
+
+static void print_stats(struct decoder *d) {
+  printf("\n%lu records, %lu messages could not be decoded\n", d->records,
+         d->unknown);
+
+  for (int dir = 0; dir < 2; dir++) {
+    struct stream *s = &d->streams[dir];
+    printf("%s %lu messages, %lu bytes\n", directions[dir], s->messages,
+           s->bytes);
+  }
+
+  print_hottest(d);
+
+  printf("\nlargest messages:\n");
+  for (size_t i = 0; i < d->largest_count; i++) {
+    struct message_info *m = &d->largest[i];
+    const struct xdwl_method *method =
+        !m->interface ? NULL
+        : m->direction == XDWL_CAPTURE_SENT
+            ? &m->interface->requests[m->opcode]
+            : &m->interface->events[m->opcode];
+
+    printf("  %8u %12.6f %s %s#%u.%s\n", m->size, m->time_ns / 1e9,
+           directions[m->direction], m->interface ? m->interface->name : "?",
+           m->object_id, method ? method->name : "?");
+  }
+
+  for (int dir = 0; dir < 2; dir++) {
+    struct stream *s = &d->streams[dir];
+    uint64_t max = 0;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+      max = s->histogram[i] > max ? s->histogram[i] : max;
+    if (max == 0)
+      continue;
+
+    printf("\n%s inter-arrival:\n", directions[dir]);
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+      if (s->histogram[i] == 0)
+        continue;
+
+      printf("  < %10lu us %10lu ", 2ul << i, s->histogram[i]);
+      for (uint64_t j = 0; j < s->histogram[i] * 40 / max; j++)
+        putchar('#');
+      putchar('\n');
+    }
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-p protocol.so]... [-q] [-s] [-n top] capture\n"
+          "  -p  load a scanner generated protocol library\n"
+          "  -q  don't print messages, only statistics\n"
+          "  -s  print statistics after the messages\n"
+          "  -n  entries in the top lists, default %d\n",
+          name, DEFAULT_TOP);
+}
+
+int main(int argc, char *argv[]) {
+  struct decoder *d = calloc(1, sizeof(struct decoder));
+  int stats = 0, opt;
+
+  if (!d) {
+    perror("calloc");
+    return 1;
+  }
+  d->top = DEFAULT_TOP;
+
+  while ((opt = getopt(argc, argv, "p:qsn:")) != -1) {
+    switch (opt) {
+    case 'p':
+      // its constructor registers the interfaces
+      if (!dlopen(optarg, RTLD_NOW | RTLD_GLOBAL)) {
+        fprintf(stderr, "%s\n", dlerror());
+        return 1;
+      }
+      break;
+    case 'q':
+      d->quiet = 1;
+      stats = 1;
+      break;
+    case 's':
+      stats = 1;
+      break;
+    case 'n':
+      d->top = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1 || d->top == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(argv[optind], "rb");
+  if (!file) {
+    perror(argv[optind]);
+    return 1;
+  }
+  setvbuf(file, NULL, _IOFBF, READ_BUFFER_SIZE);
+
+  struct xdwl_capture_header header;
+  if (!xdwl_capture_read_header(file, &header)) {
+    fprintf(stderr, "%s isn't a capture\n", argv[optind]);
+    return 1;
+  }
+
+  char *payload = malloc(XDWL_CAPTURE_MAX_RECORD);
+  d->largest = malloc(d->top * sizeof(struct message_info));
+  d->objects = xdwl_map_new(64);
+  d->stats = xdwl_map_new(64);
+  if (!payload || !d->largest || !d->objects || !d->stats) {
+    perror("malloc");
+    return 1;
+  }
+
+  object_set(d, 1, interface_named("wl_display"));
+
+  struct xdwl_capture_record record;
+  int r;
+
+  while ((r = xdwl_capture_read(file, &record, payload)) == 1) {
+    if (decode_record(d, &record, payload) == -1)
+      break;
+  }
+
+  if (r == -1)
+    xdwl_error_print();
+
+  if (stats)
+    print_stats(d);
+
+  struct xdwl_map_pair *p;
+  xdwl_map_for_each(d->stats, p) {
+    free(((struct interface_stats *)p->value)->opcodes);
+  }
+
+  xdwl_map_destroy(d->stats);
+  xdwl_map_destroy(d->objects);
+  free(d->largest);
+  free(payload);
+  free(d);
+  fclose(file);
+
+  return r == -1;
+}